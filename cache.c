@@ -0,0 +1,77 @@
+#include "cache.h"
+#include <stdlib.h>
+#include <gmp.h>
+
+// multipliers for mixing limbs into the hash
+#define HASH_SEED 0x9E3779B97F4A7C15ull
+#define HASH_MUL  0xFF51AFD7ED558CCDull
+
+// Returns a fast, non-cryptographic 64-bit hash of the limbs of x
+static uint64_t hash_block(mpz_t x) {
+    const mp_limb_t *limbs = mpz_limbs_read(x);
+    size_t size = mpz_size(x);
+    uint64_t h = HASH_SEED ^ size;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ (uint64_t) limbs[i]) * HASH_MUL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+// Initializes an empty cache with room for entries blocks
+bool cache_init(cache_t *c, uint64_t entries) {
+    c->entries = entries > 0 ? entries : 1;
+    c->keys = (mpz_t *) calloc(c->entries, sizeof(mpz_t));
+    c->values = (mpz_t *) calloc(c->entries, sizeof(mpz_t));
+    c->used = (bool *) calloc(c->entries, sizeof(bool));
+    if (c->keys == NULL || c->values == NULL || c->used == NULL) {
+        free(c->keys);
+        free(c->values);
+        free(c->used);
+        c->keys = NULL;
+        c->values = NULL;
+        c->used = NULL;
+        return false;
+    }
+    for (uint64_t i = 0; i < c->entries; i++) {
+        mpz_inits(c->keys[i], c->values[i], NULL);
+    }
+    c->lookups = 0;
+    c->hits = 0;
+    return true;
+}
+
+// Sets value to the cached result for key, if there is one
+bool cache_get(cache_t *c, mpz_t value, mpz_t key) {
+    // each block can only live in the one slot its hash picks
+    uint64_t slot = hash_block(key) % c->entries;
+    c->lookups += 1;
+    // compare the whole block, since different blocks can share a hash
+    if (!c->used[slot] || mpz_cmp(c->keys[slot], key) != 0) {
+        return false;
+    }
+    mpz_set(value, c->values[slot]);
+    c->hits += 1;
+    return true;
+}
+
+// Stores value as the result for key, evicting the block in its slot
+void cache_put(cache_t *c, mpz_t key, mpz_t value) {
+    uint64_t slot = hash_block(key) % c->entries;
+    mpz_set(c->keys[slot], key);
+    mpz_set(c->values[slot], value);
+    c->used[slot] = true;
+}
+
+// Frees every block held by the cache
+void cache_clear(cache_t *c) {
+    for (uint64_t i = 0; i < c->entries; i++) {
+        mpz_clears(c->keys[i], c->values[i], NULL);
+    }
+    free(c->keys);
+    free(c->values);
+    free(c->used);
+    c->keys = NULL;
+    c->values = NULL;
+    c->used = NULL;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <gmp.h>
+
+// largest number of blocks a cache may be given
+#define CACHE_MAX_ENTRIES (1ull << 24)
+
+//
+// A bounded cache of block results under one key.
+// Encryption and decryption are deterministic, so a block that was seen
+// before always maps to the same result, and repeated blocks (such as the
+// zero pages of sparse images) can skip their exponentiation. Each slot
+// holds the full input next to its result, so a hash collision can only
+// cost a miss, never a wrong result.
+//
+typedef struct {
+    uint64_t entries; // number of slots, each holding at most one block
+    mpz_t *keys; // block inputs
+    mpz_t *values; // block results
+    bool *used; // whether each slot holds a block yet
+    uint64_t lookups; // blocks looked up
+    uint64_t hits; // blocks found
+} cache_t;
+
+//
+// Initializes an empty cache.
+//
+// c: the cache to initialize.
+// entries: number of blocks the cache can hold, from 1 to CACHE_MAX_ENTRIES.
+// returns false, leaving nothing allocated, if the slots could not be allocated.
+//
+bool cache_init(cache_t *c, uint64_t entries);
+
+//
+// Looks up the result for a block.
+//
+// Provides:
+//  value: the cached result when found
+//  returns true if key was found
+//
+// Requires:
+//  c: initialized cache
+//  key: block input
+//
+bool cache_get(cache_t *c, mpz_t value, mpz_t key);
+
+//
+// Stores the result for a block, replacing whatever shared its slot.
+//
+// Requires:
+//  c: initialized cache
+//  key: block input
+//  value: block result
+//
+void cache_put(cache_t *c, mpz_t key, mpz_t value);
+
+//
+// Frees every block held by the cache.
+//
+void cache_clear(cache_t *c);
@@ -1,15 +1,28 @@
 #include "ss.h"
 #include "numtheory.h"
 #include "randstate.h"
+#include "tune.h"
 #include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
 #include <gmp.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
-#define OPTIONS "hi:o:n:v"
+#define OPTIONS "hi:o:n:vArm:S:R:c:"
+
+// Runs the decrypt file loop under the private key arg, { d, pq }, for tune_run
+static bool decrypt_loop(FILE *in, FILE *out, void *arg) {
+    mpz_ptr *key = (mpz_ptr *) arg;
+    uint64_t bytes;
+    return ss_decrypt_file(in, out, key[0], key[1], &bytes);
+}
 
 int main(int argc, char **argv) {
     // set defaults for encrypt
@@ -17,7 +30,17 @@ int main(int argc, char **argv) {
     bool verbose = false;
     FILE *infile = stdin;
     FILE *outfile = stdout;
-    FILE *keyfile;
+    FILE *keyfile = NULL;
+    char *outname = NULL;
+    FILE *mfile = NULL;
+    bool sharded = false;
+    bool records = false;
+    bool autotune = false;
+    char *checkpoint = NULL;
+    uint64_t entries = 0;
+    char *end = NULL;
+    uint64_t shard = 0;
+    uint64_t shards = 1;
 
     int opt = 0;
     while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
@@ -31,9 +54,15 @@ int main(int argc, char **argv) {
                             "OPTIONS\n"
                             "   -h              Display program help and usage.\n"
                             "   -v              Display verbose program output.\n"
+                            "   -A              Tune for this host and key size and save the profile.\n"
+                            "   -c entries      Cache the results of up to entries repeated blocks.\n"
                             "   -i infile       Input file of data to decrypt (default: stdin).\n"
                             "   -o outfile      Output file for decrypted data (default: stdout).\n"
-                            "   -n pvfile       Private key file (default: ss.priv).\n");
+                            "   -n pvfile       Private key file (default: ss.priv).\n"
+                            "   -m manifest     Decrypt the shards listed in a manifest.\n"
+                            "   -S i/N          With -m, decrypt only shard i of N into its place.\n"
+                            "   -r              Decrypt a stream of framed record ciphertexts.\n"
+                            "   -R checkpoint   Resume from checkpoint if it exists, saving progress to it.\n");
             return 0;
         case 'i':
             infile = fopen(optarg, "r");
@@ -44,12 +73,8 @@ int main(int argc, char **argv) {
             }
             break;
         case 'o':
-            outfile = fopen(optarg, "w+");
-            if (outfile == NULL) { // in event of failure to open file
-                // print error message
-                perror("The output file could not be opened.");
-                return 1;
-            }
+            // opened once the options are known, since a shard must not truncate it
+            outname = optarg;
             break;
         case 'n':
             usersetkey = true;
@@ -61,6 +86,37 @@ int main(int argc, char **argv) {
             }
             break;
         case 'v': verbose = true; break;
+        case 'r': records = true; break;
+        case 'A': autotune = true; break;
+        case 'R': checkpoint = optarg; break;
+        case 'c':
+            // number of blocks the result cache may hold, 0 for no cache
+            errno = 0;
+            entries = strtoull(optarg, &end, 10);
+            if (!isdigit((unsigned char) optarg[0]) || *end != '\0' || errno != 0
+                || entries > CACHE_MAX_ENTRIES) {
+                fprintf(stderr, "The cache size must be from 0 to %llu blocks.\n",
+                    CACHE_MAX_ENTRIES);
+                return 1;
+            }
+            break;
+        case 'm':
+            mfile = fopen(optarg, "r");
+            if (mfile == NULL) { // in event of failure to open file
+                // print error message
+                perror("The manifest file could not be opened.");
+                return 1;
+            }
+            break;
+        case 'S':
+            // specify which shard of the manifest to decrypt
+            if (sscanf(optarg, "%" SCNu64 "/%" SCNu64, &shard, &shards) != 2 || shards == 0
+                || shard >= shards) {
+                fprintf(stderr, "The shard must be given as i/N with 0 <= i < N.\n");
+                return 1;
+            }
+            sharded = true;
+            break;
         default:
             fprintf(stderr, "SYNOPSIS\n"
                             "   Decrypts data using SS decryption.\n"
@@ -70,9 +126,42 @@ int main(int argc, char **argv) {
                             "OPTIONS\n"
                             "   -h              Display program help and usage.\n"
                             "   -v              Display verbose program output.\n"
+                            "   -A              Tune for this host and key size and save the profile.\n"
+                            "   -c entries      Cache the results of up to entries repeated blocks.\n"
                             "   -i infile       Input file of data to decrypt (default: stdin).\n"
                             "   -o outfile      Output file for decrypted data (default: stdout).\n"
-                            "   -n pvfile       Private key file (default: ss.priv).\n");
+                            "   -n pvfile       Private key file (default: ss.priv).\n"
+                            "   -m manifest     Decrypt the shards listed in a manifest.\n"
+                            "   -S i/N          With -m, decrypt only shard i of N into its place.\n"
+                            "   -r              Decrypt a stream of framed record ciphertexts.\n"
+                            "   -R checkpoint   Resume from checkpoint if it exists, saving progress to it.\n");
+            return 1;
+        }
+    }
+
+    if (sharded && (mfile == NULL || outname == NULL)) {
+        fprintf(stderr, "Decrypting a single shard needs -m manifest and -o outfile.\n");
+        return 1;
+    }
+    if (checkpoint != NULL && (infile == stdin || outname == NULL)) {
+        fprintf(stderr, "Resuming needs -i infile and -o outfile.\n");
+        return 1;
+    }
+    if (checkpoint != NULL && (mfile != NULL || records)) {
+        // only whole-file runs save checkpoints, and -R keeps the old output
+        fprintf(stderr, "Resuming cannot be combined with -m or -r.\n");
+        return 1;
+    }
+    if (outname != NULL) {
+        // shards write into their own region of a shared file and a resumed
+        // run keeps what earlier runs wrote, so only a fresh whole-file
+        // decryption truncates it
+        bool keep = sharded || checkpoint != NULL;
+        int fd = open(outname, keep ? O_RDWR | O_CREAT : O_RDWR | O_CREAT | O_TRUNC, 0644);
+        outfile = fd < 0 ? NULL : fdopen(fd, "w+");
+        if (outfile == NULL) { // in event of failure to open file
+            // print error message
+            perror("The output file could not be opened.");
             return 1;
         }
     }
@@ -95,14 +184,148 @@ int main(int argc, char **argv) {
     // read in private key from opened private key file
     ss_read_priv(pq, d, keyfile);
 
+    // tune for this host and key size, or reuse the saved tuning
+    if (autotune) {
+        // time the file loop on the first lines of the input, since only
+        // real ciphertexts decrypt to well-formed blocks
+        uint8_t *sample;
+        size_t len = tune_sample_lines(&sample, TUNE_SAMPLE_BLOCKS, infile, pq);
+        mpz_ptr key[2] = { d, pq };
+        tune_run(d, pq, sample, len, decrypt_loop, key);
+        free(sample);
+        if (!tune_save(tune_path(), "decrypt", mpz_sizeinbase(pq, 2))) {
+            perror("The tuning profile could not be saved.");
+        }
+    } else {
+        tune_load(tune_path(), "decrypt", mpz_sizeinbase(pq, 2));
+    }
+    // stream buffers have to be set before anything is read or written
+    if (tuning.iobuf > 0) {
+        setvbuf(infile, NULL, _IOFBF, tuning.iobuf);
+        setvbuf(outfile, NULL, _IOFBF, tuning.iobuf);
+    }
+
+    // reuse the results of repeated blocks if a cache was asked for
+    cache_t cache;
+    if (entries > 0) {
+        if (!cache_init(&cache, entries)) {
+            fprintf(stderr, "Could not allocate a cache of %" PRIu64 " blocks.\n", entries);
+            return 1;
+        }
+        ss_use_cache(&cache);
+    }
+
     // if verbose output enabled, print respective info
     if (verbose) {
         gmp_fprintf(stdout, "pq (%d bits) = %Zd\n", mpz_sizeinbase(pq, 2), pq);
         gmp_fprintf(stdout, "d (%d bits) = %Zd\n", mpz_sizeinbase(d, 2), d);
+        fprintf(stdout, "threads = %u, window = %u, batch = %u, iobuf = %u\n", tuning.threads,
+            tuning.window, tuning.batch, tuning.iobuf);
+    }
+
+    if (records) {
+        // decrypt record by record rather than as one byte stream
+        if (!ss_decrypt_records(infile, outfile, d, pq)) {
+            fprintf(stderr, "A record ciphertext is malformed.\n");
+            return 1;
+        }
+    } else if (mfile != NULL) {
+        // decrypt the shards listed in the manifest
+        uint64_t total, blockbytes, count;
+        char **files = ss_read_manifest(mfile, &total, &blockbytes, &count);
+        fclose(mfile);
+        if (files == NULL) {
+            fprintf(stderr, "The manifest file is malformed or lists too many shards.\n");
+            return 1;
+        }
+        if (sharded && shards != count) {
+            fprintf(stderr, "The manifest lists %" PRIu64 " shards, not %" PRIu64 ".\n", count,
+                shards);
+            ss_clear_manifest(files, count);
+            return 1;
+        }
+        // shards may be decrypted into a file that held something longer, so cut it
+        // to the plaintext size; every shard only writes below total, so this is
+        // safe to do from each of several shard runs at once
+        if (sharded && ftruncate(fileno(outfile), total) != 0) {
+            perror("The output file could not be truncated.");
+            ss_clear_manifest(files, count);
+            return 1;
+        }
+        // every shard starts on a block boundary, so its plaintext offset is known up front
+        uint64_t written = 0;
+        uint64_t first = sharded ? shard : 0;
+        uint64_t last = sharded ? shard + 1 : count;
+        for (uint64_t i = first; i < last; i++) {
+            FILE *shardfile = fopen(files[i], "r");
+            if (shardfile == NULL) { // in event of failure to open file
+                // print error message
+                perror("A shard file could not be opened.");
+                ss_clear_manifest(files, count);
+                return 1;
+            }
+            uint64_t offset, length;
+            ss_shard_range(total, blockbytes, i, count, &offset, &length);
+            if (sharded) {
+                fseek(outfile, offset, SEEK_SET);
+            }
+            if (verbose) {
+                fprintf(stdout, "shard %" PRIu64 "/%" PRIu64 " (%s) = bytes [%" PRIu64 ", %" PRIu64 ")\n",
+                    i, count, files[i], offset, offset + length);
+            }
+            uint64_t bytes;
+            bool ok = ss_decrypt_file(shardfile, outfile, d, pq, &bytes);
+            fclose(shardfile);
+            if (!ok) {
+                fprintf(stderr, "Shard %" PRIu64 " (%s) is not a ciphertext file.\n", i, files[i]);
+                ss_clear_manifest(files, count);
+                return 1;
+            }
+            // a missing or extra block would shift or overwrite the next shard
+            if (bytes != length) {
+                fprintf(stderr, "Shard %" PRIu64 " decrypted to %" PRIu64 " bytes, not %" PRIu64 ".\n",
+                    i, bytes, length);
+                ss_clear_manifest(files, count);
+                return 1;
+            }
+            written += bytes;
+        }
+        if (!sharded && written != total) {
+            fprintf(stderr, "The shards decrypted to %" PRIu64 " bytes, not %" PRIu64 ".\n", written,
+                total);
+            ss_clear_manifest(files, count);
+            return 1;
+        }
+        ss_clear_manifest(files, count);
+    } else if (checkpoint != NULL) {
+        // decrypt file, picking up after the last checkpoint if there is one
+        ss_checkpoint_t cp;
+        if (verbose && ss_read_checkpoint(checkpoint, &cp) > 0) {
+            fprintf(stdout, "resuming at block %" PRIu64 " (input byte %" PRIu64 ")\n", cp.blocks,
+                cp.inoff);
+        }
+        if (!ss_decrypt_resumable(infile, outfile, d, pq, checkpoint)) {
+            fprintf(stderr, "The checkpoint is for another run or key, does not fit these files or could "
+                            "not be saved.\n");
+            return 1;
+        }
+    } else {
+        // decrypt file
+        uint64_t bytes;
+        if (!ss_decrypt_file(infile, outfile, d, pq, &bytes)) {
+            fprintf(stderr, "The input is not a ciphertext file.\n");
+            return 1;
+        }
     }
 
-    // decrypt file
-    ss_decrypt_file(infile, outfile, d, pq);
+    if (entries > 0) {
+        if (verbose) {
+            fprintf(stdout, "cache hits = %" PRIu64 " of %" PRIu64 " blocks (%.1f%%)\n", cache.hits,
+                cache.lookups, cache.lookups > 0 ? 100.0 * cache.hits / cache.lookups : 0.0);
+        }
+        ss_use_cache(NULL);
+        cache_clear(&cache);
+    }
 
     // close private key file and clear mpz vars used
     fclose(infile);
@@ -1,15 +1,35 @@
 #include "ss.h"
 #include "numtheory.h"
 #include "randstate.h"
+#include "tune.h"
 #include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
 #include <gmp.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
-#define OPTIONS "hi:o:n:v"
+#define OPTIONS "hi:o:n:vArS:m:R:c:H:p:P:"
+
+// Returns true if name is an existing file that f also has open
+static bool same_file(const char *name, FILE *f) {
+    struct stat a, b;
+    return name != NULL && f != NULL && stat(name, &a) == 0 && fstat(fileno(f), &b) == 0
+           && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+// Runs the encrypt file loop under the public key arg, for tune_run
+static bool encrypt_loop(FILE *in, FILE *out, void *arg) {
+    ss_encrypt_file(in, out, (mpz_ptr) arg);
+    return true;
+}
 
 int main(int argc, char **argv) {
     // set defaults for encrypt
@@ -17,7 +37,21 @@ int main(int argc, char **argv) {
     bool verbose = false;
     FILE *infile = stdin;
     FILE *outfile = stdout;
-    FILE *keyfile;
+    FILE *keyfile = NULL;
+    char *outname = NULL;
+    FILE *mfile = NULL;
+    bool sharded = false;
+    bool records = false;
+    bool autotune = false;
+    char *checkpoint = NULL;
+    uint64_t entries = 0;
+    char *end = NULL;
+    char *hashname = NULL;
+    FILE *hashfile = NULL;
+    FILE *prevfile = NULL;
+    FILE *prevhashes = NULL;
+    uint64_t shard = 0;
+    uint64_t shards = 1;
 
     int opt = 0;
     while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
@@ -27,13 +61,23 @@ int main(int argc, char **argv) {
                             "   Encrypts data using SS encryption.\n"
                             "   Decrypted data is encrypted by the encrypt program.\n\n"
                             "USAGE\n"
-                            "   ./encrypt [OPTIONS]\n\n"
+                            "   ./encrypt [OPTIONS]\n"
+                            "   ./encrypt [OPTIONS] -m manifest shardfile...\n\n"
                             "OPTIONS\n"
                             "   -h              Display program help and usage.\n"
                             "   -v              Display verbose program output.\n"
+                            "   -A              Tune for this host and key size and save the profile.\n"
+                            "   -c entries      Cache the results of up to entries repeated blocks.\n"
                             "   -i infile       Input file of data to encrypt (default: stdin).\n"
                             "   -o outfile      Output file for encrypted data (default: stdout).\n"
-                            "   -n pbfile       Public key file (default: ss.pub).\n");
+                            "   -n pbfile       Public key file (default: ss.pub).\n"
+                            "   -S i/N          Encrypt only shard i of N (infile must be a file).\n"
+                            "   -m manifest     Write a manifest joining the given shard files.\n"
+                            "   -r              Encrypt a stream of length-prefixed records.\n"
+                            "   -R checkpoint   Resume from checkpoint if it exists, saving progress to it.\n"
+                            "   -H hashfile     Write a hash of each plaintext block to hashfile.\n"
+                            "   -p prevfile     Previous ciphertext of infile, to reuse unchanged blocks.\n"
+                            "   -P prevhashes   Hash file written alongside prevfile.\n");
             return 0;
         case 'i':
             infile = fopen(optarg, "r");
@@ -44,12 +88,8 @@ int main(int argc, char **argv) {
             }
             break;
         case 'o':
-            outfile = fopen(optarg, "w+");
-            if (outfile == NULL) { // in event of failure to open file
-                // print error message
-                perror("The output file could not be opened.");
-                return 1;
-            }
+            // opened once the options are known, since resuming must not truncate it
+            outname = optarg;
             break;
         case 'n':
             usersetkey = true;
@@ -61,18 +101,129 @@ int main(int argc, char **argv) {
             }
             break;
         case 'v': verbose = true; break;
+        case 'r': records = true; break;
+        case 'A': autotune = true; break;
+        case 'R': checkpoint = optarg; break;
+        case 'c':
+            // number of blocks the result cache may hold, 0 for no cache
+            errno = 0;
+            entries = strtoull(optarg, &end, 10);
+            if (!isdigit((unsigned char) optarg[0]) || *end != '\0' || errno != 0
+                || entries > CACHE_MAX_ENTRIES) {
+                fprintf(stderr, "The cache size must be from 0 to %llu blocks.\n",
+                    CACHE_MAX_ENTRIES);
+                return 1;
+            }
+            break;
+        case 'S':
+            // specify which shard of the input to encrypt
+            if (sscanf(optarg, "%" SCNu64 "/%" SCNu64, &shard, &shards) != 2 || shards == 0
+                || shard >= shards) {
+                fprintf(stderr, "The shard must be given as i/N with 0 <= i < N.\n");
+                return 1;
+            }
+            sharded = true;
+            break;
+        case 'H':
+            // opened once the inputs are known not to be overwritten
+            hashname = optarg;
+            break;
+        case 'p':
+            prevfile = fopen(optarg, "r");
+            if (prevfile == NULL) { // in event of failure to open file
+                // print error message
+                perror("The previous ciphertext file could not be opened.");
+                return 1;
+            }
+            break;
+        case 'P':
+            prevhashes = fopen(optarg, "r");
+            if (prevhashes == NULL) { // in event of failure to open file
+                // print error message
+                perror("The previous hash file could not be opened.");
+                return 1;
+            }
+            break;
+        case 'm':
+            mfile = fopen(optarg, "w");
+            if (mfile == NULL) { // in event of failure to open file
+                // print error message
+                perror("The manifest file could not be opened.");
+                return 1;
+            }
+            break;
         default:
             fprintf(stderr, "SYNOPSIS\n"
                             "   Encrypts data using SS encryption.\n"
                             "   Decrypted data is encrypted by the decrypt program.\n\n"
                             "USAGE\n"
-                            "   ./encrypt [OPTIONS]\n\n"
+                            "   ./encrypt [OPTIONS]\n"
+                            "   ./encrypt [OPTIONS] -m manifest shardfile...\n\n"
                             "OPTIONS\n"
                             "   -h              Display program help and usage.\n"
                             "   -v              Display verbose program output.\n"
+                            "   -A              Tune for this host and key size and save the profile.\n"
+                            "   -c entries      Cache the results of up to entries repeated blocks.\n"
                             "   -i infile       Input file of data to encrypt (default: stdin).\n"
                             "   -o outfile      Output file for encrypted data (default: stdout).\n"
-                            "   -n pbfile       Public key file (default: ss.pub).\n");
+                            "   -n pbfile       Public key file (default: ss.pub).\n"
+                            "   -S i/N          Encrypt only shard i of N (infile must be a file).\n"
+                            "   -m manifest     Write a manifest joining the given shard files.\n"
+                            "   -r              Encrypt a stream of length-prefixed records.\n"
+                            "   -R checkpoint   Resume from checkpoint if it exists, saving progress to it.\n"
+                            "   -H hashfile     Write a hash of each plaintext block to hashfile.\n"
+                            "   -p prevfile     Previous ciphertext of infile, to reuse unchanged blocks.\n"
+                            "   -P prevhashes   Hash file written alongside prevfile.\n");
+            return 1;
+        }
+    }
+
+    if ((prevfile == NULL) != (prevhashes == NULL)) {
+        fprintf(stderr, "Reusing blocks needs both -p prevfile and -P prevhashes.\n");
+        return 1;
+    }
+    if ((hashname != NULL || prevfile != NULL) && infile == stdin) {
+        fprintf(stderr, "Hashing blocks needs -i infile, not stdin.\n");
+        return 1;
+    }
+    if ((hashname != NULL || prevfile != NULL)
+        && (sharded || mfile != NULL || records || checkpoint != NULL)) {
+        fprintf(stderr, "Hashing blocks cannot be combined with -S, -m, -r or -R.\n");
+        return 1;
+    }
+    if (checkpoint != NULL && (infile == stdin || outname == NULL)) {
+        fprintf(stderr, "Resuming needs -i infile and -o outfile.\n");
+        return 1;
+    }
+    if (checkpoint != NULL && (sharded || mfile != NULL || records)) {
+        // only whole-file runs save checkpoints, and -R keeps the old output
+        fprintf(stderr, "Resuming cannot be combined with -S, -m or -r.\n");
+        return 1;
+    }
+    // the outputs are truncated, so neither may be a file this run still reads
+    FILE *inputs[] = { infile, prevfile, prevhashes };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        if (same_file(outname, inputs[i]) || same_file(hashname, inputs[i])) {
+            fprintf(stderr, "The output and hash files must not be -i, -p or -P files.\n");
+            return 1;
+        }
+    }
+    if (outname != NULL) {
+        // a resumed run keeps what earlier runs already wrote
+        bool keep = checkpoint != NULL;
+        int fd = open(outname, keep ? O_RDWR | O_CREAT : O_RDWR | O_CREAT | O_TRUNC, 0644);
+        outfile = fd < 0 ? NULL : fdopen(fd, "w+");
+        if (outfile == NULL) { // in event of failure to open file
+            // print error message
+            perror("The output file could not be opened.");
+            return 1;
+        }
+    }
+    if (hashname != NULL) {
+        hashfile = fopen(hashname, "w");
+        if (hashfile == NULL) { // in event of failure to open file
+            // print error message
+            perror("The hash file could not be opened.");
             return 1;
         }
     }
@@ -90,21 +241,137 @@ int main(int argc, char **argv) {
     // init vars used when reading in public key
     mpz_t n;
     mpz_init(n);
-    char *username = getenv("USER");
+    char username[LOGIN_NAME_MAX];
 
     // read in public key from opened public key file
     ss_read_pub(n, username, keyfile);
 
+    // tune for this host and key size, or reuse the saved tuning
+    if (autotune) {
+        // time the file loop on random plaintext
+        uint8_t *sample;
+        size_t len = tune_sample_plain(&sample, TUNE_SAMPLE_BLOCKS, ss_block_bytes(n));
+        tune_run(n, n, sample, len, encrypt_loop, n);
+        free(sample);
+        if (!tune_save(tune_path(), "encrypt", mpz_sizeinbase(n, 2))) {
+            perror("The tuning profile could not be saved.");
+        }
+    } else {
+        tune_load(tune_path(), "encrypt", mpz_sizeinbase(n, 2));
+    }
+    // stream buffers have to be set before anything is read or written
+    if (tuning.iobuf > 0) {
+        setvbuf(infile, NULL, _IOFBF, tuning.iobuf);
+        setvbuf(outfile, NULL, _IOFBF, tuning.iobuf);
+    }
+
+    // reuse the results of repeated blocks if a cache was asked for
+    cache_t cache;
+    if (entries > 0) {
+        if (!cache_init(&cache, entries)) {
+            fprintf(stderr, "Could not allocate a cache of %" PRIu64 " blocks.\n", entries);
+            return 1;
+        }
+        ss_use_cache(&cache);
+    }
+
     // if verbose output enabled, print respective info
     if (verbose) {
         fprintf(stdout, "user = %s\n", username);
         gmp_fprintf(stdout, "n (%d bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
+        fprintf(stdout, "threads = %u, window = %u, batch = %u, iobuf = %u\n", tuning.threads,
+            tuning.window, tuning.batch, tuning.iobuf);
     }
 
-    // encrypt file
-    ss_encrypt_file(infile, outfile, n);
+    if ((sharded || mfile != NULL) && infile == stdin) {
+        fprintf(stderr, "Sharding needs an input file, not stdin.\n");
+        return 1;
+    }
+    // find the size of the whole input, which every shard is cut from
+    uint64_t total = 0;
+    if (sharded || mfile != NULL) {
+        long end = fseek(infile, 0, SEEK_END) == 0 ? ftell(infile) : -1;
+        if (end < 0) {
+            perror("The size of the input file could not be found.");
+            return 1;
+        }
+        total = (uint64_t) end;
+    }
+
+    if (records) {
+        // encrypt record by record rather than as one byte stream
+        if (!ss_encrypt_records(infile, outfile, n)) {
+            fprintf(stderr, "A record is malformed or longer than %" PRIu64 " bytes.\n",
+                ss_block_bytes(n));
+            return 1;
+        }
+    } else if (mfile != NULL) {
+        // merge step: record the shard files, in order, against the input
+        if (optind >= argc) {
+            fprintf(stderr, "No shard files given for the manifest.\n");
+            return 1;
+        }
+        if ((uint64_t) (argc - optind) > ss_max_shards(total, ss_block_bytes(n))) {
+            fprintf(stderr, "More shard files given than the input has blocks.\n");
+            return 1;
+        }
+        ss_write_manifest(mfile, total, ss_block_bytes(n), argv + optind, argc - optind);
+        fclose(mfile);
+    } else if (sharded) {
+        // encrypt just this shard's block-aligned byte range
+        uint64_t offset, length;
+        ss_shard_range(total, ss_block_bytes(n), shard, shards, &offset, &length);
+        if (verbose) {
+            fprintf(stdout, "shard %" PRIu64 "/%" PRIu64 " = bytes [%" PRIu64 ", %" PRIu64 ")\n",
+                shard, shards, offset, offset + length);
+        }
+        ss_encrypt_range(infile, outfile, n, offset, length);
+    } else if (checkpoint != NULL) {
+        // encrypt file, picking up after the last checkpoint if there is one
+        ss_checkpoint_t cp;
+        if (verbose && ss_read_checkpoint(checkpoint, &cp) > 0) {
+            fprintf(stdout, "resuming at block %" PRIu64 " (input byte %" PRIu64 ")\n", cp.blocks,
+                cp.inoff);
+        }
+        if (!ss_encrypt_resumable(infile, outfile, n, checkpoint)) {
+            fprintf(stderr, "The checkpoint is for another run or key, does not fit these files or could "
+                            "not be saved.\n");
+            return 1;
+        }
+    } else if (hashfile != NULL || prevfile != NULL) {
+        // encrypt file, hashing each block and copying through unchanged ones
+        uint64_t blocks, reused;
+        if (!ss_encrypt_incremental(
+                infile, outfile, n, prevfile, prevhashes, hashfile, &blocks, &reused)) {
+            fprintf(stderr,
+                "The previous files are malformed, do not match or were not made with this key.\n");
+            return 1;
+        }
+        if (verbose) {
+            fprintf(stdout, "reused = %" PRIu64 " of %" PRIu64 " blocks\n", reused, blocks);
+        }
+    } else {
+        // encrypt file
+        ss_encrypt_file(infile, outfile, n);
+    }
+
+    if (entries > 0) {
+        if (verbose) {
+            fprintf(stdout, "cache hits = %" PRIu64 " of %" PRIu64 " blocks (%.1f%%)\n", cache.hits,
+                cache.lookups, cache.lookups > 0 ? 100.0 * cache.hits / cache.lookups : 0.0);
+        }
+        ss_use_cache(NULL);
+        cache_clear(&cache);
+    }
 
     // close public key file and clear mpz vars used
+    if (hashfile != NULL) {
+        fclose(hashfile);
+    }
+    if (prevfile != NULL) {
+        fclose(prevfile);
+        fclose(prevhashes);
+    }
     fclose(infile);
     fclose(outfile);
     fclose(keyfile);
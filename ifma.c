@@ -0,0 +1,216 @@
+#include "ifma.h"
+#include "tune.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <gmp.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define IFMA_X86 1
+#endif
+
+#define LIMB_BITS 52
+#define LIMB_NAILS (64 - LIMB_BITS)
+#define LIMB_MASK ((UINT64_C(1) << LIMB_BITS) - 1)
+// unreduced accumulators grow by 4 * 2^52 per row, so this keeps them below 2^64
+#define MAX_LIMBS 512
+
+#ifdef IFMA_X86
+// set once by detect_ifma, which pow_mod_parallel's threads may race to run
+static pthread_once_t detected = PTHREAD_ONCE_INIT;
+static bool supported = false;
+
+// Asks the CPU for AVX-512 IFMA
+static void detect_ifma(void) {
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma");
+}
+#endif
+
+// Reports whether the CPU supports AVX-512 IFMA, checking only once
+bool ifma_available(void) {
+#ifdef IFMA_X86
+    pthread_once(&detected, detect_ifma);
+    return supported;
+#else
+    return false;
+#endif
+}
+
+// Reports whether the kernel can raise bases to d modulo n on this CPU
+bool ifma_usable(mpz_t d, mpz_t n) {
+    // one spare bit keeps the unreduced Montgomery product below 2^(52L)
+    size_t L = (mpz_sizeinbase(n, 2) + 1 + LIMB_BITS - 1) / LIMB_BITS;
+    return ifma_available() && mpz_odd_p(n) && mpz_cmp_ui(n, 1) > 0 && mpz_sgn(d) > 0
+           && L <= MAX_LIMBS;
+}
+
+#ifdef IFMA_X86
+
+#define IFMA_TARGET __attribute__((target("avx512f,avx512ifma")))
+
+// Montgomery product r = a * b / 2^(52L) (mod m) in every lane.
+// a and b must be fully reduced; r may alias a or b. t is scratch for L vectors.
+IFMA_TARGET static void mont_mul(__m512i *r, const __m512i *a, const __m512i *b,
+    const __m512i *m, __m512i n0, size_t L, __m512i *t) {
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i mask = _mm512_set1_epi64(LIMB_MASK);
+    for (size_t j = 0; j < L; j++) {
+        t[j] = zero;
+    }
+    for (size_t i = 0; i < L; i++) {
+        __m512i bi = b[i];
+        // pick u so that the lowest limb becomes divisible by 2^52
+        __m512i t0 = _mm512_madd52lo_epu64(t[0], a[0], bi);
+        __m512i u = _mm512_madd52lo_epu64(zero, t0, n0);
+        t0 = _mm512_madd52lo_epu64(t0, m[0], u);
+        __m512i carry = _mm512_srli_epi64(t0, LIMB_BITS);
+        // add the rest of the row and shift everything down one limb
+        for (size_t j = 1; j < L; j++) {
+            __m512i x = t[j];
+            x = _mm512_madd52lo_epu64(x, a[j], bi);
+            x = _mm512_madd52lo_epu64(x, m[j], u);
+            x = _mm512_madd52hi_epu64(x, a[j - 1], bi);
+            x = _mm512_madd52hi_epu64(x, m[j - 1], u);
+            t[j - 1] = x;
+        }
+        t[L - 1] = _mm512_madd52hi_epu64(
+            _mm512_madd52hi_epu64(zero, a[L - 1], bi), m[L - 1], u);
+        t[0] = _mm512_add_epi64(t[0], carry);
+    }
+    // propagate carries so every limb is back under 2^52
+    __m512i c = zero;
+    for (size_t j = 0; j < L; j++) {
+        __m512i x = _mm512_add_epi64(t[j], c);
+        c = _mm512_srli_epi64(x, LIMB_BITS);
+        t[j] = _mm512_and_si512(x, mask);
+    }
+    // t < 2m, so subtract m once in the lanes where that does not borrow
+    __m512i borrow = zero;
+    for (size_t j = 0; j < L; j++) {
+        __m512i x = _mm512_sub_epi64(_mm512_sub_epi64(t[j], m[j]), borrow);
+        borrow = _mm512_srli_epi64(x, 63);
+        r[j] = _mm512_and_si512(x, mask);
+    }
+    __mmask8 keep = _mm512_cmpneq_epi64_mask(borrow, zero);
+    for (size_t j = 0; j < L; j++) {
+        r[j] = _mm512_mask_blend_epi64(keep, r[j], t[j]);
+    }
+}
+
+// Runs the fixed-window exponentiation on values already in Montgomery form.
+// table[0] holds R mod m and table[1] holds the bases; acc receives the
+// result converted back out of Montgomery form.
+IFMA_TARGET static void mont_pow(__m512i *acc, __m512i *table, const __m512i *one, mpz_t d,
+    const __m512i *m, uint64_t n0word, size_t L, __m512i *t, int window) {
+    __m512i n0 = _mm512_set1_epi64((long long) n0word);
+    for (size_t w = 2; w < ((size_t) 1 << window); w++) {
+        mont_mul(table + w * L, table + (w - 1) * L, table + L, m, n0, L, t);
+    }
+    memcpy(acc, table, L * sizeof(__m512i));
+    size_t bits = mpz_sizeinbase(d, 2);
+    size_t top = (bits + window - 1) / window * window;
+    for (size_t pos = top; pos > 0; pos -= window) {
+        if (pos != top) {
+            for (int s = 0; s < window; s++) {
+                mont_mul(acc, acc, acc, m, n0, L, t);
+            }
+        }
+        unsigned w = 0;
+        for (int b = window; b > 0; b--) {
+            w = (w << 1) | (unsigned) mpz_tstbit(d, pos - window + b - 1);
+        }
+        if (w != 0) {
+            mont_mul(acc, acc, table + w * L, m, n0, L, t);
+        }
+    }
+    // multiplying by plain 1 leaves Montgomery form
+    mont_mul(acc, acc, one, m, n0, L, t);
+}
+
+// Writes x as L 52-bit limbs into lane of the transposed vector array v
+static void scatter_lane(__m512i *v, size_t L, int lane, mpz_t x) {
+    uint64_t limbs[MAX_LIMBS] = { 0 };
+    size_t count = 0;
+    mpz_export(limbs, &count, -1, sizeof(uint64_t), 0, LIMB_NAILS, x);
+    uint64_t *words = (uint64_t *) v;
+    for (size_t j = 0; j < L; j++) {
+        words[j * IFMA_LANES + lane] = limbs[j];
+    }
+}
+
+// Reads lane of the transposed vector array v back into x
+static void gather_lane(mpz_t x, const __m512i *v, size_t L, int lane) {
+    uint64_t limbs[MAX_LIMBS];
+    const uint64_t *words = (const uint64_t *) v;
+    for (size_t j = 0; j < L; j++) {
+        limbs[j] = words[j * IFMA_LANES + lane];
+    }
+    mpz_import(x, L, -1, sizeof(uint64_t), 0, LIMB_NAILS, limbs);
+}
+
+#endif
+
+// Computes o[i] = a[i]^d (mod n) for up to eight bases in lockstep
+bool ifma_pow_mod(mpz_t o[], mpz_t a[], size_t k, mpz_t d, mpz_t n) {
+#ifdef IFMA_X86
+    if (k < 1 || k > IFMA_LANES || !ifma_usable(d, n)) {
+        return false;
+    }
+    size_t L = (mpz_sizeinbase(n, 2) + 1 + LIMB_BITS - 1) / LIMB_BITS;
+    int window = (int) tune_window();
+    size_t vecs = L * (((size_t) 1 << window) + 4);
+    __m512i *mem = (__m512i *) aligned_alloc(64, vecs * sizeof(__m512i));
+    if (mem == NULL) {
+        return false;
+    }
+    memset(mem, 0, vecs * sizeof(__m512i));
+    __m512i *m = mem;
+    __m512i *acc = m + L;
+    __m512i *t = acc + L;
+    __m512i *one = t + L;
+    __m512i *table = one + L;
+
+    mpz_t x, r;
+    mpz_inits(x, r, NULL);
+    // n0 = -n^-1 mod 2^52
+    mpz_setbit(r, LIMB_BITS);
+    mpz_invert(x, n, r);
+    mpz_sub(x, r, x);
+    uint64_t n0 = mpz_get_ui(x);
+    // R = 2^(52L) mod n, which is 1 in Montgomery form
+    mpz_set_ui(r, 0);
+    mpz_setbit(r, LIMB_BITS * L);
+    mpz_mod(r, r, n);
+    for (int lane = 0; lane < IFMA_LANES; lane++) {
+        scatter_lane(m, L, lane, n);
+        scatter_lane(table, L, lane, r);
+        // unused lanes just repeat the last base
+        mpz_mod(x, a[(size_t) lane < k ? (size_t) lane : k - 1], n);
+        mpz_mul_2exp(x, x, LIMB_BITS * L);
+        mpz_mod(x, x, n);
+        scatter_lane(table + L, L, lane, x);
+        ((uint64_t *) one)[lane] = 1;
+    }
+
+    mont_pow(acc, table, one, d, m, n0, L, t, window);
+    for (size_t lane = 0; lane < k; lane++) {
+        gather_lane(o[lane], acc, L, (int) lane);
+    }
+
+    mpz_clears(x, r, NULL);
+    free(mem);
+    return true;
+#else
+    (void) o;
+    (void) a;
+    (void) k;
+    (void) d;
+    (void) n;
+    return false;
+#endif
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <gmp.h>
+
+// number of independent exponentiations run in lockstep by one kernel call
+#define IFMA_LANES 8
+
+//
+// Reports whether the running CPU supports AVX-512 IFMA.
+// The result is computed once and cached.
+//
+bool ifma_available(void);
+
+//
+// Reports whether ifma_pow_mod can raise bases to d modulo n: the CPU has
+// IFMA, n is odd and above 1, d is positive and n fits the kernel.
+//
+bool ifma_usable(mpz_t d, mpz_t n);
+
+//
+// Computes o[i] = a[i]^d (mod n) for up to IFMA_LANES bases at once,
+// using 52-bit limbs and Montgomery multiplication on AVX-512 IFMA.
+//
+// Provides:
+//  o: k results, each fully reduced modulo n
+//
+// Requires:
+//  a: k bases, 1 <= k <= IFMA_LANES
+//  d: exponent shared by every lane
+//  n: odd modulus shared by every lane
+//  all mpz_t arguments to be initialized
+//
+// Returns false without touching o when the kernel cannot be used
+// (see ifma_usable, or k out of range, or its scratch cannot be allocated).
+//
+bool ifma_pow_mod(mpz_t o[], mpz_t a[], size_t k, mpz_t d, mpz_t n);
@@ -7,10 +7,11 @@
 #include <stdlib.h>
 #include <time.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
-#define OPTIONS "hb:i:n:d:s:v"
+#define OPTIONS "hb:i:n:d:s:vP:"
 
 int main(int argc, char **argv) {
     // set default values for kegen
@@ -20,6 +21,8 @@ int main(int argc, char **argv) {
     bool verbose = false;
     bool usersetpub = false;
     bool usersetpriv = false;
+    bool profiled = false;
+    ss_profile_t profile = SS_PROFILE_THROUGHPUT;
     FILE *pbfile;
     FILE *pvfile;
 
@@ -39,7 +42,8 @@ int main(int argc, char **argv) {
                 "   -i iterations   Miller-Rabin iterations for testing primes (default: 50).\n"
                 "   -n pbfile       Public key file (default: ss.pub).\n"
                 "   -d pvfile       Private key file (default: ss.priv).\n"
-                "   -s seed         Random seed for testing.\n");
+                "   -s seed         Random seed for testing.\n"
+                "   -P profile      Choose the p/q split for throughput or latency.\n");
             return 0;
         case 'b':
             // specify minimum bits for n
@@ -77,6 +81,18 @@ int main(int argc, char **argv) {
             // enable verbose output
             verbose = true;
             break;
+        case 'P':
+            // specify key profile
+            if (strcmp(optarg, "throughput") == 0) {
+                profile = SS_PROFILE_THROUGHPUT;
+            } else if (strcmp(optarg, "latency") == 0) {
+                profile = SS_PROFILE_LATENCY;
+            } else {
+                fprintf(stderr, "The profile must be throughput or latency.\n");
+                return 1;
+            }
+            profiled = true;
+            break;
         default:
             fprintf(stderr,
                 "SYNOPSIS\n"
@@ -90,7 +106,8 @@ int main(int argc, char **argv) {
                 "   -i iterations   Miller-Rabin iterations for testing primes (default: 50).\n"
                 "   -n pbfile       Public key file (default: ss.pub).\n"
                 "   -d pvfile       Private key file (default: ss.priv).\n"
-                "   -s seed         Random seed for testing.\n");
+                "   -s seed         Random seed for testing.\n"
+                "   -P profile      Choose the p/q split for throughput or latency.\n");
             return 1;
         }
     }
@@ -118,12 +135,19 @@ int main(int argc, char **argv) {
     fchmod(fileno(pbfile), 0600);
 
     // initialize random state
-    randstate_init(seed);
+    randstate_t rs;
+    randstate_init(&rs, seed);
 
     // make public and private keys
     mpz_t p, q, n, d, pq;
     mpz_inits(p, q, n, d, pq, NULL);
-    ss_make_pub(p, q, n, minbits, iters);
+    if (profiled) {
+        // size p deliberately instead of by chance
+        uint64_t sizeofp = ss_profile_psize(minbits, profile);
+        ss_make_pub_split(p, q, n, minbits, sizeofp, iters, &rs);
+    } else {
+        ss_make_pub(p, q, n, minbits, iters, &rs);
+    }
     ss_make_priv(d, pq, p, q);
 
     // get username
@@ -143,10 +167,18 @@ int main(int argc, char **argv) {
         gmp_fprintf(stderr, "d (%i bits) = %Zd\n", mpz_sizeinbase(d, 2), d);
     }
 
+    // if a profile was chosen, report how fast the new key should be
+    if (profiled) {
+        double encrate, decrate;
+        ss_calibrate(n, d, pq, profile == SS_PROFILE_THROUGHPUT, &encrate, &decrate, &rs);
+        fprintf(stderr, "predicted encrypt = %.2f MB/s\n", encrate / 1e6);
+        fprintf(stderr, "predicted decrypt = %.2f MB/s\n", decrate / 1e6);
+    }
+
     // close files, clear random state, clear mpz_t variables used
     fclose(pbfile);
     fclose(pvfile);
-    randstate_clear();
+    randstate_clear(&rs);
     mpz_clears(p, q, n, d, pq, NULL);
     return 0;
 }
@@ -1,39 +1,91 @@
 #include "numtheory.h"
 #include "randstate.h"
+#include "ifma.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <gmp.h>
 
 // Performs modular exponentiation, computing the base (a) raised to the
 // exponent power (d) modulo modulus (n) and storing the result in output (o)
 void pow_mod(mpz_t o, mpz_t a, mpz_t d, mpz_t n) {
-    mpz_t p, v, dd;
-    mpz_init_set(dd, d);
-    // v = 1
-    mpz_init_set_ui(v, 1);
-    // p = a
-    mpz_init_set(p, a);
-    // while d > 0
-    while (mpz_cmp_ui(dd, 0) > 0) {
-        // if d % 2 == 1
-        if (mpz_odd_p(dd) != 0) {
-            // o = (v * p) % n
-            mpz_mul(v, v, p); // (v * p)
-            mpz_mod(v, v, n); // (v * p) % n
+    // GMP's sliding-window Montgomery exponentiation on its assembly mpn kernels
+    mpz_powm(o, a, d, n);
+}
+
+// Performs k modular exponentiations that share exponent d and modulus n,
+// computing o[i] = a[i]^d (mod n). Groups of blocks go through the AVX-512
+// IFMA kernel when the CPU has it and n suits it, anything else falls back
+// to pow_mod.
+void pow_mod_batch(mpz_t o[], mpz_t a[], size_t k, mpz_t d, mpz_t n) {
+    // whether the kernel applies depends only on the CPU, d and n, so ask once
+    bool ifma = ifma_usable(d, n);
+    size_t i = 0;
+    while (i < k) {
+        size_t lanes = k - i < IFMA_LANES ? k - i : IFMA_LANES;
+        // a lone block is cheaper through the scalar path
+        if (!ifma || lanes < 2 || !ifma_pow_mod(o + i, a + i, lanes, d, n)) {
+            for (size_t j = i; j < i + lanes; j++) {
+                pow_mod(o[j], a[j], d, n);
+            }
+        }
+        i += lanes;
+    }
+}
+
+// A slice of a batch of exponentiations for one worker thread
+typedef struct {
+    mpz_t *o;
+    mpz_t *a;
+    size_t k;
+    mpz_ptr d;
+    mpz_ptr n;
+} pow_job_t;
+
+// Thread body that runs the exponentiations described by a pow_job_t
+static void *pow_job(void *arg) {
+    pow_job_t *job = (pow_job_t *) arg;
+    pow_mod_batch(job->o, job->a, job->k, job->d, job->n);
+    return NULL;
+}
+
+// Performs k modular exponentiations that share exponent d and modulus n,
+// split across threads, with the last slice run on the calling thread
+void pow_mod_parallel(mpz_t o[], mpz_t a[], size_t k, mpz_t d, mpz_t n, uint32_t threads) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    // hand each thread whole groups of lanes so every kernel call is full
+    size_t groups = (k + IFMA_LANES - 1) / IFMA_LANES;
+    size_t per = (groups + threads - 1) / threads * IFMA_LANES;
+    pthread_t *tids = (pthread_t *) calloc(threads, sizeof(pthread_t));
+    pow_job_t *jobs = (pow_job_t *) calloc(threads, sizeof(pow_job_t));
+    bool *started = (bool *) calloc(threads, sizeof(bool));
+    size_t first = 0;
+    for (uint32_t t = 0; t < threads && first < k; t++) {
+        size_t count = k - first < per ? k - first : per;
+        jobs[t] = (pow_job_t) { o + first, a + first, count, d, n };
+        if (first + count < k) {
+            started[t] = pthread_create(&tids[t], NULL, pow_job, &jobs[t]) == 0;
+        }
+        if (!started[t]) {
+            pow_job(&jobs[t]);
+        }
+        first += count;
+    }
+    for (uint32_t t = 0; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(tids[t], NULL);
         }
-        // p = (p * p) % n
-        mpz_mul(p, p, p); // (p * p)
-        mpz_mod(p, p, n); // (p * p) % n
-        // d /= 2
-        mpz_fdiv_q_ui(dd, dd, 2);
     }
-    mpz_set(o, v);
-    mpz_clears(v, p, dd, NULL);
+    free(started);
+    free(jobs);
+    free(tids);
 }
 
 // Conducts the Miller-Rabin primality test to indicate whether or not n is prime
-bool is_prime(mpz_t n, uint64_t iters) {
+bool is_prime(mpz_t n, uint64_t iters, randstate_t *rs) {
     // some obvious cases to check for before doing too much:
     // if n is even and greater than 2, not prime
     if (mpz_get_ui(n) % 2 == 0 && mpz_cmp_ui(n, 2) > 0) {
@@ -64,7 +116,7 @@ bool is_prime(mpz_t n, uint64_t iters) {
     for (mpz_init_set_ui(i, 1); mpz_cmp(i, k) < 0; mpz_add_ui(i, i, 1)) {
         // choose random a = {2, 3, ..., n - 2}
         mpz_sub_ui(nmin3, n, 3);
-        mpz_urandomm(a, state, nmin3); // a = {0, n - 4}
+        randstate_urandomm(a, rs, nmin3); // a = {0, n - 4}
         mpz_add_ui(a, a, 2); // a = {2, n - 2}
         // y = pow_mod(a, r, n);
         pow_mod(y, a, r, n);
@@ -100,14 +152,14 @@ bool is_prime(mpz_t n, uint64_t iters) {
 }
 
 // Generates a new prime number that is at least bits number of bits long.
-void make_prime(mpz_t p, uint64_t bits, uint64_t iters) {
+void make_prime(mpz_t p, uint64_t bits, uint64_t iters, randstate_t *rs) {
     bool prime_made = false;
     // until prime is made
     while (!prime_made) {
         // generate random number as mpz var
-        mpz_urandomb(p, state, bits);
+        randstate_urandomb(p, rs, bits);
         // check if random number is prime and is at least size of bits
-        if (is_prime(p, iters) && mpz_sizeinbase(p, 2) + 1 >= bits) {
+        if (is_prime(p, iters, rs) && mpz_sizeinbase(p, 2) + 1 >= bits) {
             prime_made = true;
         }
     }
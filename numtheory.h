@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <gmp.h>
+#include "randstate.h"
 
 void gcd(mpz_t g, mpz_t a, mpz_t b);
 
@@ -11,6 +12,10 @@ void mod_inverse(mpz_t o, mpz_t a, mpz_t n);
 
 void pow_mod(mpz_t o, mpz_t a, mpz_t d, mpz_t n);
 
-bool is_prime(mpz_t n, uint64_t iters);
+void pow_mod_batch(mpz_t o[], mpz_t a[], size_t k, mpz_t d, mpz_t n);
 
-void make_prime(mpz_t p, uint64_t bits, uint64_t iters);
+void pow_mod_parallel(mpz_t o[], mpz_t a[], size_t k, mpz_t d, mpz_t n, uint32_t threads);
+
+bool is_prime(mpz_t n, uint64_t iters, randstate_t *rs);
+
+void make_prime(mpz_t p, uint64_t bits, uint64_t iters, randstate_t *rs);
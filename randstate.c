@@ -1,22 +1,113 @@
 #include "randstate.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <gmp.h>
 
-// declare state var
-gmp_randstate_t state;
+// Philox4x32 round multipliers and key schedule constants
+#define PHILOX_M0     0xD2511F53u
+#define PHILOX_M1     0xCD9E8D57u
+#define PHILOX_W0     0x9E3779B9u
+#define PHILOX_W1     0xBB67AE85u
+#define PHILOX_ROUNDS 10
 
-// Initializes the global random state with a
-// Mersenne Twister algorithm, using seed as the random seed.
-void randstate_init(uint64_t seed) {
-    // initialize the mersenne twister algorithm and set the seed (for gmp functions)
-    gmp_randinit_mt(state);
-    gmp_randseed_ui(state, seed);
-    // set seed for C random functions
-    srandom(seed);
+// Runs the Philox4x32-10 bijection, encrypting counter ctr under key into out
+static void philox(uint32_t out[4], const uint32_t ctr[4], const uint32_t key[2]) {
+    uint32_t c[4] = { ctr[0], ctr[1], ctr[2], ctr[3] };
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int r = 0; r < PHILOX_ROUNDS; r++) {
+        uint64_t p0 = (uint64_t) PHILOX_M0 * c[0];
+        uint64_t p1 = (uint64_t) PHILOX_M1 * c[2];
+        uint32_t n0 = (uint32_t) (p1 >> 32) ^ c[1] ^ k0;
+        uint32_t n2 = (uint32_t) (p0 >> 32) ^ c[3] ^ k1;
+        c[0] = n0;
+        c[1] = (uint32_t) p1;
+        c[2] = n2;
+        c[3] = (uint32_t) p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    memcpy(out, c, sizeof(c));
 }
 
-// Clears and frees all memory used by the initialized global random state
-void randstate_clear(void) {
-    gmp_randclear(state);
+// Initializes the random state with the Philox counter-based generator,
+// using seed as the key
+void randstate_init(randstate_t *rs, uint64_t seed) {
+    memset(rs, 0, sizeof(*rs));
+    rs->key[0] = (uint32_t) seed;
+    rs->key[1] = (uint32_t) (seed >> 32);
+    // nothing buffered yet
+    rs->used = 4;
+}
+
+// Derives an independent child stream from parent
+void randstate_split(randstate_t *child, randstate_t *parent, uint64_t stream) {
+    // output blocks always have ctr[2] = 0, so a counter with ctr[2] = 1 is
+    // never handed out and can safely be used to derive the child's key
+    uint32_t ctr[4] = { (uint32_t) stream, (uint32_t) (stream >> 32), 1, 0 };
+    uint32_t out[4];
+    philox(out, ctr, parent->key);
+    memset(child, 0, sizeof(*child));
+    child->key[0] = out[0];
+    child->key[1] = out[1];
+    child->used = 4;
+}
+
+// Returns the next 32 random bits, producing a new block when needed
+static uint32_t next_word(randstate_t *rs) {
+    if (rs->used == 4) {
+        philox(rs->buf, rs->ctr, rs->key);
+        // advance the 64-bit block counter
+        if (++rs->ctr[0] == 0) {
+            rs->ctr[1] += 1;
+        }
+        rs->used = 0;
+    }
+    return rs->buf[rs->used++];
+}
+
+// Returns 64 random bits
+uint64_t randstate_u64(randstate_t *rs) {
+    uint64_t lo = next_word(rs);
+    uint64_t hi = next_word(rs);
+    return (hi << 32) | lo;
+}
+
+// Sets r to a random integer below 2^bits
+void randstate_urandomb(mpz_t r, randstate_t *rs, uint64_t bits) {
+    uint64_t words = (bits + 31) / 32;
+    if (words == 0) {
+        mpz_set_ui(r, 0);
+        return;
+    }
+    // pack the words least significant first straight into r's limbs, so
+    // the only allocation is GMP's own
+    mp_size_t limbs = (mp_size_t) ((bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS);
+    mp_limb_t *limb = mpz_limbs_write(r, limbs);
+    for (mp_size_t i = 0; i < limbs; i++) {
+        limb[i] = 0;
+    }
+    for (uint64_t i = 0; i < words; i++) {
+        uint32_t word = next_word(rs);
+        // drop the bits above the requested size from the top word
+        if (i == words - 1 && bits % 32 != 0) {
+            word &= (UINT32_C(1) << (bits % 32)) - 1;
+        }
+        limb[i * 32 / GMP_NUMB_BITS] |= (mp_limb_t) word << (i * 32 % GMP_NUMB_BITS);
+    }
+    mpz_limbs_finish(r, limbs);
+}
+
+// Sets r to a random integer below n
+void randstate_urandomm(mpz_t r, randstate_t *rs, mpz_t n) {
+    // draw just enough bits and reject anything at or above n
+    uint64_t bits = mpz_sizeinbase(n, 2);
+    do {
+        randstate_urandomb(r, rs, bits);
+    } while (mpz_cmp(r, n) >= 0);
+}
+
+// Wipes the key and buffered output of the random state
+void randstate_clear(randstate_t *rs) {
+    memset(rs, 0, sizeof(*rs));
 }
@@ -3,18 +3,55 @@
 #include <stdint.h>
 #include <gmp.h>
 
-extern gmp_randstate_t state;
+//
+// A counter-based random state (Philox4x32-10).
+// Every output block is a keyed function of its counter, so a state can be
+// split into independent streams without any shared or global state, and
+// each thread can own its own stream without locking.
+//
+typedef struct {
+    uint32_t key[2]; // derived from the seed, or from the parent when split
+    uint32_t ctr[4]; // ctr[0..1] count output blocks, ctr[2..3] stay 0
+    uint32_t buf[4]; // output of the most recent block
+    int used; // words of buf already handed out
+} randstate_t;
 
 //
-// Initializes the random state needed for SS key generation operations.
-// Must be called before any key generation or number theory operations are used.
+// Initializes a random state for SS key generation operations.
+// Must be called before any key generation or number theory operations use it.
 //
+// rs: the random state to initialize.
 // seed: the seed to seed the random state with.
 //
-void randstate_init(uint64_t seed);
+void randstate_init(randstate_t *rs, uint64_t seed);
+
+//
+// Initializes child as an independent stream split off from parent.
+// The child depends only on the parent's seed and stream, never on how much
+// of the parent has been used, so splits are reproducible.
+//
+// child: the random state to initialize.
+// parent: an initialized random state.
+// stream: stream number; distinct numbers give independent streams.
+//
+void randstate_split(randstate_t *child, randstate_t *parent, uint64_t stream);
+
+//
+// Returns 64 uniformly random bits.
+//
+uint64_t randstate_u64(randstate_t *rs);
+
+//
+// Sets r to a uniformly random integer in [0, 2^bits).
+//
+void randstate_urandomb(mpz_t r, randstate_t *rs, uint64_t bits);
+
+//
+// Sets r to a uniformly random integer in [0, n). n must be positive.
+//
+void randstate_urandomm(mpz_t r, randstate_t *rs, mpz_t n);
 
 //
-// Frees any memory used by the initialized random state.
-// Must be called after all key generation or number theory operations are used.
+// Wipes a random state once it is no longer needed.
 //
-void randstate_clear(void);
+void randstate_clear(randstate_t *rs);
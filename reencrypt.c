@@ -0,0 +1,159 @@
+#include "ss.h"
+#include "numtheory.h"
+#include "randstate.h"
+#include <stdio.h>
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define OPTIONS "hi:o:d:n:t:v"
+
+int main(int argc, char **argv) {
+    // set defaults for reencrypt
+    bool usersetpriv = false;
+    bool usersetpub = false;
+    bool verbose = false;
+    FILE *infile = stdin;
+    FILE *outfile = stdout;
+    FILE *pvfile;
+    FILE *pbfile;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t threads = online > 0 ? (uint32_t) online : 1;
+
+    int opt = 0;
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'h':
+            fprintf(stderr, "SYNOPSIS\n"
+                            "   Re-encrypts SS encrypted data under a new public key.\n"
+                            "   Plaintext is only ever held in memory.\n\n"
+                            "USAGE\n"
+                            "   ./reencrypt [OPTIONS]\n\n"
+                            "OPTIONS\n"
+                            "   -h              Display program help and usage.\n"
+                            "   -v              Display verbose program output.\n"
+                            "   -i infile       Input file of data to re-encrypt (default: stdin).\n"
+                            "   -o outfile      Output file for re-encrypted data (default: stdout).\n"
+                            "   -d pvfile       Old private key file (default: ss.priv).\n"
+                            "   -n pbfile       New public key file (default: ss.pub).\n"
+                            "   -t threads      Worker threads (default: number of CPUs).\n");
+            return 0;
+        case 'i':
+            infile = fopen(optarg, "r");
+            if (infile == NULL) { // in event of failure to open file
+                // print error message
+                perror("The input file could not be opened.");
+                return 1;
+            }
+            break;
+        case 'o':
+            outfile = fopen(optarg, "w+");
+            if (outfile == NULL) { // in event of failure to open file
+                // print error message
+                perror("The output file could not be opened.");
+                return 1;
+            }
+            break;
+        case 'd':
+            usersetpriv = true;
+            pvfile = fopen(optarg, "r");
+            if (pvfile == NULL) { // in event of failure to open file
+                // print error message
+                perror("The private key file could not be opened.");
+                return 1;
+            }
+            break;
+        case 'n':
+            usersetpub = true;
+            pbfile = fopen(optarg, "r");
+            if (pbfile == NULL) { // in event of failure to open file
+                // print error message
+                perror("The public key file could not be opened.");
+                return 1;
+            }
+            break;
+        case 't':
+            // specify number of worker threads
+            threads = strtoul(optarg, NULL, 10);
+            if (threads < 1) {
+                fprintf(stderr, "At least one thread is needed.\n");
+                return 1;
+            }
+            break;
+        case 'v': verbose = true; break;
+        default:
+            fprintf(stderr, "SYNOPSIS\n"
+                            "   Re-encrypts SS encrypted data under a new public key.\n"
+                            "   Plaintext is only ever held in memory.\n\n"
+                            "USAGE\n"
+                            "   ./reencrypt [OPTIONS]\n\n"
+                            "OPTIONS\n"
+                            "   -h              Display program help and usage.\n"
+                            "   -v              Display verbose program output.\n"
+                            "   -i infile       Input file of data to re-encrypt (default: stdin).\n"
+                            "   -o outfile      Output file for re-encrypted data (default: stdout).\n"
+                            "   -d pvfile       Old private key file (default: ss.priv).\n"
+                            "   -n pbfile       New public key file (default: ss.pub).\n"
+                            "   -t threads      Worker threads (default: number of CPUs).\n");
+            return 1;
+        }
+    }
+
+    // open default key files the user hasn't set,
+    // printing error message in case of failure
+    if (!usersetpriv) {
+        pvfile = fopen("ss.priv", "r");
+        if (pvfile == NULL) { // in event of failure to open file
+            // print error message
+            perror("The private key file could not be opened.");
+            return 1;
+        }
+    }
+    if (!usersetpub) {
+        pbfile = fopen("ss.pub", "r");
+        if (pbfile == NULL) { // in event of failure to open file
+            // print error message
+            perror("The public key file could not be opened.");
+            return 1;
+        }
+    }
+
+    // read in the old private key and the new public key
+    mpz_t pq, d, n;
+    mpz_inits(pq, d, n, NULL);
+    char username[LOGIN_NAME_MAX];
+    ss_read_priv(pq, d, pvfile);
+    ss_read_pub(n, username, pbfile);
+    if (!ss_key_fits(n)) {
+        fprintf(stderr, "The new public key is too small to carry any data.\n");
+        return 1;
+    }
+
+    // if verbose output enabled, print respective info
+    if (verbose) {
+        gmp_fprintf(stderr, "old pq (%d bits) = %Zd\n", mpz_sizeinbase(pq, 2), pq);
+        gmp_fprintf(stderr, "old d (%d bits) = %Zd\n", mpz_sizeinbase(d, 2), d);
+        fprintf(stderr, "user = %s\n", username);
+        gmp_fprintf(stderr, "new n (%d bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
+        fprintf(stderr, "threads = %u\n", threads);
+    }
+
+    // re-encrypt file
+    if (!ss_reencrypt_file(infile, outfile, d, pq, n, threads)) {
+        fprintf(stderr, "The input is not a ciphertext of the old key, or was cut short.\n");
+        return 1;
+    }
+
+    // close files and clear mpz vars used
+    fclose(infile);
+    fclose(outfile);
+    fclose(pvfile);
+    fclose(pbfile);
+    mpz_clears(pq, d, n, NULL);
+    return 0;
+}
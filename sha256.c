@@ -0,0 +1,97 @@
+#include "sha256.h"
+#include <string.h>
+
+// first 32 bits of the fractional parts of the cube roots of the first 64 primes
+static const uint32_t K[64] = { 0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B,
+    0x59F111F1, 0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74,
+    0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F,
+    0x4A7484AA, 0x5CB0A9DC, 0x76F988DA, 0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3,
+    0xD5A79147, 0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354,
+    0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819,
+    0xD6990624, 0xF40E3585, 0x106AA070, 0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3,
+    0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA,
+    0xA4506CEB, 0xBEF9A3F7, 0xC67178F2 };
+
+// Rotates x right by r bits
+static uint32_t rotr32(uint32_t x, int r) {
+    return (x >> r) | (x << (32 - r));
+}
+
+// Mixes one 64-byte chunk into the chaining value
+static void compress(uint32_t state[8], const uint8_t chunk[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t) chunk[4 * i] << 24 | (uint32_t) chunk[4 * i + 1] << 16
+               | (uint32_t) chunk[4 * i + 2] << 8 | (uint32_t) chunk[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g))
+                      + K[i] + w[i];
+        uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+// Starts a new digest from the standard initial value
+void sha256_init(sha256_t *s) {
+    static const uint32_t H0[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F,
+        0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+    memcpy(s->state, H0, sizeof(H0));
+    s->length = 0;
+}
+
+// Feeds len bytes of buf into the digest, compressing each full chunk
+void sha256_update(sha256_t *s, const uint8_t *buf, uint64_t len) {
+    while (len > 0) {
+        uint64_t used = s->length % 64;
+        uint64_t take = 64 - used < len ? 64 - used : len;
+        memcpy(s->buffer + used, buf, take);
+        s->length += take;
+        buf += take;
+        len -= take;
+        if (s->length % 64 == 0) {
+            compress(s->state, s->buffer);
+        }
+    }
+}
+
+// Pads the message with 0x80, zeros and its bit length, then writes the
+// chaining value out big-endian
+void sha256_final(sha256_t *s, uint8_t digest[SHA256_BYTES]) {
+    uint64_t bits = s->length * 8;
+    uint8_t pad[72] = { 0x80 };
+    uint64_t used = s->length % 64;
+    uint64_t padlen = used < 56 ? 56 - used : 120 - used;
+    for (int i = 0; i < 8; i++) {
+        pad[padlen + i] = (uint8_t) (bits >> (56 - 8 * i));
+    }
+    sha256_update(s, pad, padlen + 8);
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t) (s->state[i] >> 24);
+        digest[4 * i + 1] = (uint8_t) (s->state[i] >> 16);
+        digest[4 * i + 2] = (uint8_t) (s->state[i] >> 8);
+        digest[4 * i + 3] = (uint8_t) s->state[i];
+    }
+}
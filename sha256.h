@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+// bytes in a SHA-256 digest
+#define SHA256_BYTES 32
+
+//
+// A running SHA-256 (FIPS 180-4) computation.
+// Data is fed in with sha256_update in as many pieces as needed and the
+// digest read out once with sha256_final.
+//
+typedef struct {
+    uint32_t state[8]; // chaining value
+    uint64_t length; // bytes fed in so far
+    uint8_t buffer[64]; // bytes of the current, unfinished chunk
+} sha256_t;
+
+//
+// Starts a new digest.
+//
+void sha256_init(sha256_t *s);
+
+//
+// Feeds len bytes of buf into the digest.
+//
+void sha256_update(sha256_t *s, const uint8_t *buf, uint64_t len);
+
+//
+// Finishes the digest.
+//
+// Provides:
+//  digest: the SHA-256 of everything fed in since sha256_init
+//
+void sha256_final(sha256_t *s, uint8_t digest[SHA256_BYTES]);
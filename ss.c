@@ -1,23 +1,88 @@
 #include "ss.h"
 #include "numtheory.h"
 #include "randstate.h"
+#include "tune.h"
+#include "cache.h"
+#include "sha256.h"
 #include <stdio.h>
+#include <ctype.h>
 #include <gmp.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// number of blocks exponentiated together by one kernel call
+#define BATCH 8
+// minimum length of one timing measurement, in seconds
+#define CALIBRATE_SECONDS 0.02
+// number of records gathered before they are exponentiated together
+#define RECORD_BATCH 256
+// blocks each worker thread handles per round of re-encryption
+#define REENCRYPT_BATCH 64
+// minimum seconds between two checkpoints of a resumable run
+#define CHECKPOINT_SECONDS 5.0
+// first line of a hash manifest
+#define HASHES_MAGIC "ss-sha256\n"
+// one hash manifest entry: plaintext digest, space, line digest, newline
+#define HASH_ENTRY (4 * SHA256_BYTES + 2)
+
+// cache of block results shared by the file loops, or NULL for none
+static cache_t *block_cache = NULL;
 
 // Creates parts of a new SS public key: two large primes p and q, and
 // n computed as p * p * q
-void ss_make_pub(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t iters) {
+void ss_make_pub(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t iters, randstate_t *rs) {
     // find size of p in range [nbits/5, (2 x nbits)/5]
-    uint64_t sizeofp = random() % (((2 * nbits) / 5) - (nbits / 5)) + (nbits / 5);
+    uint64_t sizeofp = randstate_u64(rs) % (((2 * nbits) / 5) - (nbits / 5)) + (nbits / 5);
+    ss_make_pub_split(p, q, n, nbits, sizeofp, iters, rs);
+}
+
+// One prime to generate on its own thread, with its own random stream
+typedef struct {
+    mpz_ptr prime;
+    uint64_t bits;
+    uint64_t iters;
+    randstate_t rs;
+} prime_job_t;
+
+// Thread body that makes the prime described by a prime_job_t
+static void *make_prime_job(void *arg) {
+    prime_job_t *job = (prime_job_t *) arg;
+    make_prime(job->prime, job->bits, job->iters, &job->rs);
+    return NULL;
+}
+
+// Creates parts of a new SS public key with p sizeofp bits long
+void ss_make_pub_split(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t sizeofp,
+    uint64_t iters, randstate_t *rs) {
     // Since n = p * p * q, q = n - (2p)
     uint64_t sizeofq = nbits - (2 * sizeofp);
+    // give each prime its own stream so they can be searched for in parallel
+    // while staying reproducible for a given seed
+    prime_job_t pjob = { .prime = p, .bits = sizeofp + 1, .iters = iters };
+    prime_job_t qjob = { .prime = q, .bits = sizeofq + 1, .iters = iters };
+    randstate_split(&pjob.rs, rs, randstate_u64(rs));
+    randstate_split(&qjob.rs, rs, randstate_u64(rs));
     // now that we have size of p and q, make the primes
-    make_prime(p, sizeofp + 1, iters);
-    make_prime(q, sizeofq + 1, iters);
+    pthread_t qthread;
+    bool threaded = pthread_create(&qthread, NULL, make_prime_job, &qjob) == 0;
+    make_prime_job(&pjob);
+    if (threaded) {
+        pthread_join(qthread, NULL);
+    } else {
+        make_prime_job(&qjob);
+    }
+    randstate_clear(&pjob.rs);
+    randstate_clear(&qjob.rs);
     mpz_t psqr;
     mpz_init(psqr);
     mpz_mul(psqr, p, p); // psqr = p * p
@@ -25,6 +90,67 @@ void ss_make_pub(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t iters) {
     mpz_clear(psqr);
 }
 
+// Measures the seconds one block takes to raise to d modulo mod, either
+// alone or as part of a full batch, using random blocks below mod
+static double time_block(mpz_t d, mpz_t mod, bool batched, randstate_t *rs) {
+    mpz_t in[BATCH], out[BATCH];
+    for (int i = 0; i < BATCH; i++) {
+        mpz_inits(in[i], out[i], NULL);
+        randstate_urandomm(in[i], rs, mod);
+    }
+    double t = tune_pow_time(out, in, batched ? BATCH : 1, d, mod, 1, CALIBRATE_SECONDS);
+    for (int i = 0; i < BATCH; i++) {
+        mpz_clears(in[i], out[i], NULL);
+    }
+    return t;
+}
+
+// Chooses the size of p for a key of nbits under the given profile
+uint64_t ss_profile_psize(uint64_t nbits, ss_profile_t profile) {
+    uint64_t lo = nbits / 5;
+    uint64_t hi = (2 * nbits) / 5;
+    // keep q at least SS_MIN_QBITS long so the elliptic curve method cannot
+    // pull it out; where that cannot be had, make q as large as allowed
+    if (nbits < 2 * lo + SS_MIN_QBITS) {
+        return lo;
+    }
+    if (hi > (nbits - SS_MIN_QBITS) / 2) {
+        hi = (nbits - SS_MIN_QBITS) / 2;
+    }
+    if (hi <= lo + 1) {
+        return lo;
+    }
+    // n, and so encryption cost, is the same for every split, while
+    // decryption works modulo pq = n / p with an exponent just as long. One
+    // decryption costs about limbs^3 word products, in the limbs of the
+    // backend that runs it: 52-bit lanes for batched blocks, 64-bit GMP
+    // limbs for single blocks. That cost only drops when pq loses a whole
+    // limb, so take the smallest p that reaches the fewest limbs; any larger
+    // p would shrink q for no gain.
+    uint64_t word = profile == SS_PROFILE_THROUGHPUT ? 52 : 64;
+    uint64_t best = lo;
+    uint64_t bestlimbs = UINT64_MAX;
+    for (uint64_t sizeofp = lo; sizeofp < hi; sizeofp++) {
+        // p and q get one bit over their sizes, so pq has at most this many bits
+        uint64_t pqbits = nbits - sizeofp + 2;
+        uint64_t limbs = (pqbits + word - 1) / word;
+        if (limbs < bestlimbs) {
+            best = sizeofp;
+            bestlimbs = limbs;
+        }
+    }
+    return best;
+}
+
+// Predicts encryption and decryption rates in bytes per second for a key
+void ss_calibrate(mpz_t n, mpz_t d, mpz_t pq, bool batched, double *encrate, double *decrate,
+    randstate_t *rs) {
+    // every block carries the same number of plaintext bytes both ways
+    double bytes = ss_block_bytes(n);
+    *encrate = bytes / time_block(n, n, batched, rs);
+    *decrate = bytes / time_block(d, pq, batched, rs);
+}
+
 // Writes a public SS key and username to pbfile
 void ss_write_pub(mpz_t n, char username[], FILE *pbfile) {
     // print n as hexstring and username as string in pbfile, each followed by trailing newline
@@ -33,8 +159,11 @@ void ss_write_pub(mpz_t n, char username[], FILE *pbfile) {
 
 // Reads a public SS key and username from pbfile
 void ss_read_pub(mpz_t n, char username[], FILE *pbfile) {
-    // scan n and username in pbfile
-    gmp_fscanf(pbfile, "%Zx\n%s\n", n, username);
+    // scan n and username in pbfile, never past LOGIN_NAME_MAX bytes of username
+    char format[32];
+    snprintf(format, sizeof(format), "%%Zx\n%%%ds\n", LOGIN_NAME_MAX - 1);
+    username[0] = '\0';
+    gmp_fscanf(pbfile, format, n, username);
 }
 
 // Creates a new SS private key d given primes p and q and the public key n
@@ -72,18 +201,36 @@ void ss_encrypt(mpz_t c, mpz_t m, mpz_t n) {
     pow_mod(c, m, n, n);
 }
 
+// Performs SS encryption on k messages at once, c[i] = m[i]^n (mod n)
+void ss_encrypt_batch(mpz_t c[], mpz_t m[], size_t k, mpz_t n) {
+    pow_mod_batch(c, m, k, n, n);
+}
+
+// Returns true if n is large enough to carry at least one plaintext byte per block
+bool ss_key_fits(mpz_t n) {
+    // k = (0.5 * bits - 1) / 8 has to reach 2 to leave a byte beside the 0xFF
+    return mpz_sizeinbase(n, 2) >= 34;
+}
+
+// Returns the number of plaintext bytes carried by each encrypted block
+uint64_t ss_block_bytes(mpz_t n) {
+    // block size k minus the prepended 0xFF byte
+    uint64_t size = (0.5 * mpz_sizeinbase(n, 2) - 1) / 8; // note: log_2(sqrt(n)) = 0.5 * log_2(n)
+    return size - 1;
+}
+
 // Encrypts the contents of infile
 void ss_encrypt_file(FILE *infile, FILE *outfile, mpz_t n) {
-    // calculate the block size k
-    mpz_t m, c;
-    mpz_inits(m, c, NULL);
-    uint64_t size = (0.5 * mpz_sizeinbase(n, 2) - 1) / 8; // note: log_2(sqrt(n)) = 0.5 * log_2(n)
-    // dynamically allocate an array that can hold k bytes
-    uint8_t *block = (uint8_t *) calloc(size, sizeof(uint8_t));
-    // set zeroth byte of block to 0xFF
-    block[0] = 0xFF;
     // when infile is stdin
     if (infile == stdin) {
+        // calculate the block size k
+        mpz_t m, c;
+        mpz_inits(m, c, NULL);
+        uint64_t size = ss_block_bytes(n) + 1;
+        // dynamically allocate an array that can hold k bytes
+        uint8_t *block = (uint8_t *) calloc(size, sizeof(uint8_t));
+        // set zeroth byte of block to 0xFF
+        block[0] = 0xFF;
         uint64_t j = fread(block + 1, sizeof(uint8_t), size - 1, infile);
         // convert read bytes, including prepended 0xFF into mpz_t m
         mpz_import(m, j + 1, 1, 1, 1, 0, block);
@@ -95,28 +242,380 @@ void ss_encrypt_file(FILE *infile, FILE *outfile, mpz_t n) {
         mpz_clears(m, c, NULL);
         return;
     }
-    // while there are still unprocessed bytes in infile
+    // encrypt every byte from the top of the file
     uint64_t bytestoread = 0; // var for total bytes to read in file
     fseek(infile, 0, SEEK_END); // set pointer in file to end of file
     bytestoread = ftell(infile); // ftell gives total size of file
-    fseek(infile, 0, SEEK_SET); // set pointer in file back to top
+    ss_encrypt_range(infile, outfile, n, 0, bytestoread);
+}
+
+// Uses cache for the block results of the file loops
+void ss_use_cache(cache_t *cache) {
+    block_cache = cache;
+}
+
+// Raises the k blocks in a to d modulo mod into o over the worker threads,
+// taking repeated blocks from block_cache when there is one. a is reordered,
+// t is scratch space for k blocks and idx for 2k indices.
+static void pow_round(mpz_t o[], mpz_t a[], mpz_t t[], size_t idx[], size_t k, mpz_t d, mpz_t mod) {
+    if (block_cache == NULL) {
+        pow_mod_parallel(o, a, k, d, mod, tuning.threads);
+        return;
+    }
+    // move the distinct blocks the cache misses to the front so they stay
+    // one batch, and point every missed block at its distinct copy
+    size_t *from = idx + k;
+    size_t misses = 0;
+    for (size_t i = 0; i < k; i++) {
+        from[i] = k;
+        if (cache_get(block_cache, o[i], a[i])) {
+            continue;
+        }
+        size_t j = 0;
+        while (j < misses && mpz_cmp(a[j], a[i]) != 0) {
+            j += 1;
+        }
+        if (j == misses) {
+            mpz_swap(a[misses], a[i]);
+            idx[misses] = i;
+            misses += 1;
+        } else {
+            block_cache->hits += 1; // served by its copy, so it costs no exponentiation
+        }
+        from[i] = j;
+    }
+    pow_mod_parallel(t, a, misses, d, mod, tuning.threads);
+    // copy results to repeated blocks, then remember the new results and put
+    // each back in its block's place
+    for (size_t i = 0; i < k; i++) {
+        if (from[i] < k && idx[from[i]] != i) {
+            mpz_set(o[i], t[from[i]]);
+        }
+    }
+    for (size_t j = 0; j < misses; j++) {
+        cache_put(block_cache, a[j], t[j]);
+        mpz_swap(o[idx[j]], t[j]);
+    }
+}
+
+// Encrypts length bytes of infile starting at offset, saving progress in
+// cp to checkpoint every CHECKPOINT_SECONDS unless checkpoint is NULL
+static bool encrypt_range(FILE *infile, FILE *outfile, mpz_t n, uint64_t offset, uint64_t length,
+    const char *checkpoint, ss_checkpoint_t *cp) {
+    bool ok = true;
+    double last = tune_now();
+    // each round gathers a batch of blocks for every worker thread
+    size_t round = (size_t) tuning.threads * tuning.batch;
+    mpz_t *m = (mpz_t *) calloc(round, sizeof(mpz_t));
+    mpz_t *c = (mpz_t *) calloc(round, sizeof(mpz_t));
+    mpz_t *t = (mpz_t *) calloc(round, sizeof(mpz_t));
+    size_t *idx = (size_t *) calloc(2 * round, sizeof(size_t));
+    for (size_t i = 0; i < round; i++) {
+        mpz_inits(m[i], c[i], t[i], NULL);
+    }
+    // calculate the block size k
+    uint64_t size = ss_block_bytes(n) + 1;
+    // dynamically allocate an array that can hold k bytes
+    uint8_t *block = (uint8_t *) calloc(size, sizeof(uint8_t));
+    // set zeroth byte of block to 0xFF
+    block[0] = 0xFF;
+    // while there are still unprocessed bytes in the range
+    uint64_t bytestoread = length;
+    fseek(infile, offset, SEEK_SET); // set pointer in file to start of range
     while (bytestoread > 0) {
-        // read at most k - 1 bytes and let j be the number of bytes actually read
-        uint64_t j = fread(block + 1, sizeof(uint8_t), size - 1, infile);
-        if (j < 1) { // when we reach EOF
-            j = fread(
-                block + 1, sizeof(uint8_t), bytestoread, infile); // read in bytes left in file
+        // gather up to a round of blocks so they can be exponentiated together
+        size_t count = 0;
+        while (count < round && bytestoread > 0) {
+            // read at most k - 1 bytes (never past the range) and let j be the number of bytes actually read
+            uint64_t want = bytestoread < size - 1 ? bytestoread : size - 1;
+            uint64_t j = fread(block + 1, sizeof(uint8_t), want, infile);
+            if (j < 1) { // file ended before the range did
+                bytestoread = 0;
+                break;
+            }
+            bytestoread -= j; // update bytes left to read by subtracting bytes read
+            // convert read bytes, including prepended 0xFF into mpz_t m
+            mpz_import(m[count], j + 1, 1, 1, 1, 0, block);
+            count += 1;
+        }
+        // encrypt the batch and write the ciphertexts out in order
+        pow_round(c, m, t, idx, count, n, n);
+        for (size_t i = 0; i < count; i++) {
+            gmp_fprintf(outfile, "%Zx\n", c[i]);
+        }
+        // rounds end on block boundaries, so this is a consistent point to resume from
+        if (checkpoint != NULL) {
+            long pos = ftell(infile);
+            cp->inoff = (uint64_t) pos;
+            cp->blocks += count;
+            if (pos < 0) {
+                ok = false;
+                break;
+            }
+            if (tune_now() - last >= CHECKPOINT_SECONDS) {
+                if (!ss_write_checkpoint(checkpoint, outfile, cp)) {
+                    ok = false;
+                    break;
+                }
+                last = tune_now();
+            }
         }
-        bytestoread -= j; // update bytes left to read by subtracting bytes read
-        // convert read bytes, including prepended 0xFF into mpz_t m
-        mpz_import(m, j + 1, 1, 1, 1, 0, block);
-        // encrypt m
-        ss_encrypt(c, m, n);
-        gmp_fprintf(outfile, "%Zx\n", c);
     }
     free(block);
     block = NULL;
-    mpz_clears(m, c, NULL);
+    for (size_t i = 0; i < round; i++) {
+        mpz_clears(m[i], c[i], t[i], NULL);
+    }
+    free(m);
+    free(c);
+    free(t);
+    free(idx);
+    return ok;
+}
+
+// Encrypts length bytes of infile starting at offset
+void ss_encrypt_range(FILE *infile, FILE *outfile, mpz_t n, uint64_t offset, uint64_t length) {
+    encrypt_range(infile, outfile, n, offset, length, NULL, NULL);
+}
+
+// Hashes len bytes of buf into h with SHA-256
+void ss_block_hash(uint8_t h[SHA256_BYTES], const uint8_t *buf, uint64_t len) {
+    sha256_t s;
+    sha256_init(&s);
+    sha256_update(&s, buf, len);
+    sha256_final(&s, h);
+}
+
+// Hashes the public key, so hash manifests of different keys never match
+static void key_hash(uint8_t h[SHA256_BYTES], mpz_t n) {
+    size_t len = 0;
+    uint8_t *bytes = (uint8_t *) mpz_export(NULL, &len, 1, 1, 1, 0, n);
+    ss_block_hash(h, bytes, len);
+    free(bytes);
+}
+
+// Hashes a ciphertext line together with the digest of its plaintext, so
+// an entry only vouches for the line it was written next to
+static void line_hash(uint8_t h[SHA256_BYTES], const uint8_t plain[SHA256_BYTES], const char *line) {
+    sha256_t s;
+    sha256_init(&s);
+    sha256_update(&s, plain, SHA256_BYTES);
+    sha256_update(&s, (const uint8_t *) line, strlen(line));
+    sha256_final(&s, h);
+}
+
+// Writes a digest as lowercase hex
+static void put_digest(FILE *f, const uint8_t h[SHA256_BYTES]) {
+    for (int i = 0; i < SHA256_BYTES; i++) {
+        fprintf(f, "%02x", h[i]);
+    }
+}
+
+// Parses the 2 * SHA256_BYTES hex digits at hex into h
+static bool parse_digest(uint8_t h[SHA256_BYTES], const char *hex) {
+    for (int i = 0; i < SHA256_BYTES; i++) {
+        unsigned byte;
+        char pair[3] = { hex[2 * i], hex[2 * i + 1], '\0' };
+        if (!isxdigit((unsigned char) pair[0]) || !isxdigit((unsigned char) pair[1])
+            || sscanf(pair, "%2x", &byte) != 1) {
+            return false;
+        }
+        h[i] = (uint8_t) byte;
+    }
+    return true;
+}
+
+// Encrypts infile, copying through the ciphertext of every block whose
+// hash matches the previous run's and writing this run's block and line hashes
+bool ss_encrypt_incremental(FILE *infile, FILE *outfile, mpz_t n, FILE *prevfile,
+    FILE *prevhashes, FILE *hashfile, uint64_t *blocks, uint64_t *reused) {
+    *blocks = 0;
+    *reused = 0;
+    uint64_t size = ss_block_bytes(n) + 1;
+    uint8_t key[SHA256_BYTES];
+    key_hash(key, n);
+    // old ciphertext only fits if it was made with the same key and block size
+    bool prev = prevfile != NULL && prevhashes != NULL;
+    char entry[HASH_ENTRY + 1];
+    if (prev) {
+        uint64_t oldsize;
+        uint8_t oldkey[SHA256_BYTES];
+        if (fgets(entry, sizeof(entry), prevhashes) == NULL || strcmp(entry, HASHES_MAGIC) != 0
+            || fscanf(prevhashes, "%" SCNu64 "\n", &oldsize) != 1 || oldsize != size - 1
+            || fgets(entry, sizeof(entry), prevhashes) == NULL
+            || strlen(entry) != 2 * SHA256_BYTES + 1 || !parse_digest(oldkey, entry)
+            || memcmp(oldkey, key, SHA256_BYTES) != 0) {
+            return false;
+        }
+    }
+    if (hashfile != NULL) {
+        fprintf(hashfile, HASHES_MAGIC "%" PRIu64 "\n", size - 1);
+        put_digest(hashfile, key);
+        fputc('\n', hashfile);
+    }
+    // each round gathers a batch of blocks for every worker thread
+    size_t round = (size_t) tuning.threads * tuning.batch;
+    mpz_t *m = (mpz_t *) calloc(round, sizeof(mpz_t));
+    mpz_t *c = (mpz_t *) calloc(round, sizeof(mpz_t));
+    mpz_t *t = (mpz_t *) calloc(round, sizeof(mpz_t));
+    size_t *idx = (size_t *) calloc(2 * round, sizeof(size_t));
+    uint8_t(*hashes)[SHA256_BYTES] = (uint8_t(*)[SHA256_BYTES]) calloc(round, sizeof(*hashes));
+    for (size_t i = 0; i < round; i++) {
+        mpz_inits(m[i], c[i], t[i], NULL);
+    }
+    // ciphertext lines of this round, old or new; a line is never longer than n in hex
+    size_t linecap = mpz_sizeinbase(n, 16) + 3;
+    char *lines = (char *) calloc(round, linecap);
+    bool *keep = (bool *) calloc(round, sizeof(bool));
+    uint8_t *block = (uint8_t *) calloc(size, sizeof(uint8_t));
+    block[0] = 0xFF;
+    bool ok = true;
+    bool eof = false;
+    while (ok && !eof) {
+        // gather a round of blocks, setting aside only the changed ones for encryption
+        size_t count = 0;
+        size_t misses = 0;
+        while (count < round) {
+            uint64_t j = fread(block + 1, sizeof(uint8_t), size - 1, infile);
+            if (j < 1) {
+                eof = true;
+                break;
+            }
+            uint8_t *h = hashes[count];
+            ss_block_hash(h, block + 1, j);
+            // block i of the old ciphertext is line i, alongside hash entry i
+            keep[count] = false;
+            if (prev) {
+                uint8_t old[SHA256_BYTES], sum[SHA256_BYTES], oldsum[SHA256_BYTES];
+                char *line = lines + count * linecap;
+                if (fgets(entry, sizeof(entry), prevhashes) != NULL
+                    && fgets(line, linecap, prevfile) != NULL) {
+                    // the line must be the one this entry was written for
+                    if (strlen(entry) != HASH_ENTRY || entry[2 * SHA256_BYTES] != ' '
+                        || !parse_digest(old, entry)
+                        || !parse_digest(oldsum, entry + 2 * SHA256_BYTES + 1)) {
+                        ok = false;
+                        break;
+                    }
+                    line_hash(sum, old, line);
+                    if (memcmp(sum, oldsum, SHA256_BYTES) != 0) {
+                        ok = false;
+                        break;
+                    }
+                    keep[count] = memcmp(old, h, SHA256_BYTES) == 0;
+                } else {
+                    prev = false; // the old file was shorter, so the rest is all new
+                }
+            }
+            if (!keep[count]) {
+                mpz_import(m[misses], j + 1, 1, 1, 1, 0, block);
+                misses += 1;
+            }
+            count += 1;
+        }
+        // encrypt the changed blocks and write every block out in order
+        pow_round(c, m, t, idx, misses, n, n);
+        for (size_t i = 0, k = 0; ok && i < count; i++) {
+            char *line = lines + i * linecap;
+            if (keep[i]) {
+                *reused += 1;
+            } else {
+                mpz_get_str(line, 16, c[k++]);
+                strcat(line, "\n");
+            }
+            fputs(line, outfile);
+            if (hashfile != NULL) {
+                uint8_t sum[SHA256_BYTES];
+                line_hash(sum, hashes[i], line);
+                put_digest(hashfile, hashes[i]);
+                fputc(' ', hashfile);
+                put_digest(hashfile, sum);
+                fputc('\n', hashfile);
+            }
+        }
+        *blocks += count;
+    }
+    free(block);
+    free(keep);
+    free(lines);
+    free(hashes);
+    for (size_t i = 0; i < round; i++) {
+        mpz_clears(m[i], c[i], t[i], NULL);
+    }
+    free(m);
+    free(c);
+    free(t);
+    free(idx);
+    return ok;
+}
+
+// Splits total plaintext bytes into count block-aligned shards and gives
+// the byte range covered by shard index
+void ss_shard_range(uint64_t total, uint64_t blockbytes, uint64_t index, uint64_t count,
+    uint64_t *offset, uint64_t *length) {
+    // hand out whole blocks as evenly as possible
+    uint64_t blocks = (total + blockbytes - 1) / blockbytes;
+    uint64_t first = blocks * index / count;
+    uint64_t last = blocks * (index + 1) / count;
+    uint64_t end = last * blockbytes < total ? last * blockbytes : total;
+    *offset = first * blockbytes;
+    *length = end > *offset ? end - *offset : 0;
+}
+
+// Returns the most shards a plaintext can be split into: one per block, or
+// a single empty shard for an empty plaintext
+uint64_t ss_max_shards(uint64_t total, uint64_t blockbytes) {
+    uint64_t blocks = total / blockbytes + (total % blockbytes != 0);
+    return blocks > 0 ? blocks : 1;
+}
+
+// Writes a manifest tying count shard ciphertext files into one ciphertext
+void ss_write_manifest(FILE *mfile, uint64_t total, uint64_t blockbytes, char *shards[],
+    uint64_t count) {
+    // header, sizes needed to place each shard, then one shard file per line
+    fprintf(mfile, "ss-manifest\n%" PRIu64 "\n%" PRIu64 "\n%" PRIu64 "\n", total, blockbytes,
+        count);
+    for (uint64_t i = 0; i < count; i++) {
+        fprintf(mfile, "%s\n", shards[i]);
+    }
+}
+
+// Reads a manifest written by ss_write_manifest
+char **ss_read_manifest(FILE *mfile, uint64_t *total, uint64_t *blockbytes, uint64_t *count) {
+    char line[PATH_MAX + 2];
+    if (fgets(line, sizeof(line), mfile) == NULL || strcmp(line, "ss-manifest\n") != 0) {
+        return NULL;
+    }
+    if (fscanf(mfile, "%" SCNu64 "\n%" SCNu64 "\n%" SCNu64 "\n", total, blockbytes, count) != 3
+        || *blockbytes == 0 || *count == 0 || *count > ss_max_shards(*total, *blockbytes)) {
+        return NULL;
+    }
+    // one heap copy of each shard file name, in shard order
+    char **shards = (char **) calloc(*count, sizeof(char *));
+    if (shards == NULL) {
+        return NULL;
+    }
+    for (uint64_t i = 0; i < *count; i++) {
+        if (fgets(line, sizeof(line), mfile) == NULL) {
+            ss_clear_manifest(shards, i);
+            return NULL;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        shards[i] = strdup(line);
+        if (shards[i] == NULL) {
+            ss_clear_manifest(shards, i);
+            return NULL;
+        }
+    }
+    return shards;
+}
+
+// Frees the shard list returned by ss_read_manifest
+void ss_clear_manifest(char **shards, uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        free(shards[i]);
+    }
+    free(shards);
 }
 
 // Performs SS decryption, computing message by decrypting ciphertext
@@ -125,46 +624,499 @@ void ss_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t pq) {
     pow_mod(m, c, d, pq);
 }
 
-// Decrypt the contents of infile to outfile
-void ss_decrypt_file(FILE *infile, FILE *outfile, mpz_t d, mpz_t pq) {
-    // calculate size of block
-    mpz_t c, m;
-    mpz_inits(c, m, NULL);
-    uint64_t size = (mpz_sizeinbase(pq, 2) - (size_t) 1) / 8;
+// Performs SS decryption on k ciphertexts at once, m[i] = c[i]^d (mod pq)
+void ss_decrypt_batch(mpz_t m[], mpz_t c[], size_t k, mpz_t d, mpz_t pq) {
+    pow_mod_batch(m, c, k, d, pq);
+}
+
+// Decrypts the ciphertext lines of infile from its current position,
+// adding the plaintext bytes written to *written and saving progress in cp
+// to checkpoint every CHECKPOINT_SECONDS unless checkpoint is NULL
+static bool decrypt_lines(FILE *infile, FILE *outfile, mpz_t d, mpz_t pq, uint64_t *written,
+    const char *checkpoint, ss_checkpoint_t *cp) {
+    bool ok = true;
+    double last = tune_now();
+    // each round gathers a batch of blocks for every worker thread
+    size_t round = (size_t) tuning.threads * tuning.batch;
+    mpz_t *c = (mpz_t *) calloc(round, sizeof(mpz_t));
+    mpz_t *m = (mpz_t *) calloc(round, sizeof(mpz_t));
+    mpz_t *t = (mpz_t *) calloc(round, sizeof(mpz_t));
+    size_t *idx = (size_t *) calloc(2 * round, sizeof(size_t));
+    for (size_t i = 0; i < round; i++) {
+        mpz_inits(c[i], m[i], t[i], NULL);
+    }
+    // a residue mod pq takes up to this many bytes, whatever the ciphertext holds
+    uint64_t size = (mpz_sizeinbase(pq, 2) + 7) / 8;
     // dynamically allocate an array that can hold size bytes
     uint8_t *block = (uint8_t *) calloc(size, sizeof(uint8_t));
+    // iterating over the lines in infile
+    bool eof = false;
+    while (!eof) {
+        // scan in up to a round of ciphertexts so they can be exponentiated together
+        size_t count = 0;
+        while (count < round) {
+            int scan = gmp_fscanf(infile, "%Zx\n", c[count]);
+            if (scan == EOF) { // if EOF is reached
+                eof = true;
+                break;
+            }
+            if (scan < 1) { // not a hex ciphertext line
+                ok = false;
+                eof = true;
+                break;
+            }
+            count += 1;
+        }
+        // decrypt the batch back into messages
+        pow_round(m, c, t, idx, count, d, pq);
+        for (size_t i = 0; i < count; i++) {
+            // convert m back into bytes, stored in block
+            size_t j = 0; // used as count for bytes converted
+            mpz_export(block, &j, 1, 1, 1, 0, m[i]);
+            // a zero message has no prefix byte and so nothing to write
+            if (j < 1) {
+                continue;
+            }
+            // write out j - 1 bytes starting from index 1 of the block to outfile
+            fwrite(block + 1, sizeof(uint8_t), j - 1, outfile);
+            *written += j - 1;
+        }
+        // rounds end on whole lines, so this is a consistent point to resume from
+        if (checkpoint != NULL) {
+            long pos = ftell(infile);
+            cp->inoff = (uint64_t) pos;
+            cp->blocks += count;
+            if (pos < 0) {
+                ok = false;
+                break;
+            }
+            if (tune_now() - last >= CHECKPOINT_SECONDS) {
+                if (!ss_write_checkpoint(checkpoint, outfile, cp)) {
+                    ok = false;
+                    break;
+                }
+                last = tune_now();
+            }
+        }
+    }
+    free(block);
+    block = NULL;
+    for (size_t i = 0; i < round; i++) {
+        mpz_clears(c[i], m[i], t[i], NULL);
+    }
+    free(c);
+    free(m);
+    free(t);
+    free(idx);
+    return ok;
+}
+
+// Decrypt the contents of infile to outfile, returning the bytes written
+bool ss_decrypt_file(FILE *infile, FILE *outfile, mpz_t d, mpz_t pq, uint64_t *written) {
+    *written = 0;
     // if infile is stdin
     if (infile == stdin) {
-        // scan in ciphertext c
-        gmp_fscanf(infile, "%Zx\n", c);
+        mpz_t c, m;
+        mpz_inits(c, m, NULL);
+        // a residue mod pq takes up to this many bytes
+        uint64_t size = (mpz_sizeinbase(pq, 2) + 7) / 8;
+        // dynamically allocate an array that can hold size bytes
+        uint8_t *block = (uint8_t *) calloc(size, sizeof(uint8_t));
+        // scan in ciphertext c; an empty stream decrypts to nothing
+        int scan = gmp_fscanf(infile, "%Zx\n", c);
+        if (scan < 1) {
+            free(block);
+            mpz_clears(c, m, NULL);
+            return scan == EOF;
+        }
         // decrypt c back into m
         ss_decrypt(m, c, d, pq);
         // convert m back into bytes, stored in block
         size_t j = 0; // used as count for bytes converted
         mpz_export(block, &j, 1, 1, 1, 0, m);
+        // a zero message has no prefix byte and so nothing to write
+        *written = j > 0 ? j - 1 : 0;
         // write out j - 1 bytes starting from index 1 of the block to outfile
-        fwrite(block + 1, sizeof(uint8_t), j - 1, outfile);
+        fwrite(block + 1, sizeof(uint8_t), *written, outfile);
         free(block);
         block = NULL;
         mpz_clears(c, m, NULL);
-        return;
+        return true;
     }
-    // iterating over the lines in infile
-    while (1) {
-        // scan in ciphertext c
-        int scan = gmp_fscanf(infile, "%Zx\n", c);
-        if (scan < 1) { // if EOF is reached
+    return decrypt_lines(infile, outfile, d, pq, written, NULL, NULL);
+}
+
+// Reads one length-prefixed frame of at most cap bytes into buf.
+// Returns 1 for a frame, 0 at a clean end of stream and -1 if malformed.
+static int read_frame(FILE *infile, uint8_t *buf, uint64_t cap, uint64_t *len) {
+    uint8_t prefix[4];
+    size_t got = fread(prefix, sizeof(uint8_t), 4, infile);
+    if (got == 0) {
+        return 0;
+    }
+    if (got < 4) {
+        return -1;
+    }
+    // 32-bit big-endian length
+    *len = ((uint64_t) prefix[0] << 24) | ((uint64_t) prefix[1] << 16)
+           | ((uint64_t) prefix[2] << 8) | (uint64_t) prefix[3];
+    if (*len > cap || fread(buf, sizeof(uint8_t), *len, infile) != *len) {
+        return -1;
+    }
+    return 1;
+}
+
+// Writes len bytes of buf as one length-prefixed frame
+static void write_frame(FILE *outfile, const uint8_t *buf, uint64_t len) {
+    uint8_t prefix[4] = { (uint8_t) (len >> 24), (uint8_t) (len >> 16), (uint8_t) (len >> 8),
+        (uint8_t) len };
+    fwrite(prefix, sizeof(uint8_t), 4, outfile);
+    fwrite(buf, sizeof(uint8_t), len, outfile);
+}
+
+// Encrypts a stream of length-prefixed records, one ciphertext frame per record
+bool ss_encrypt_records(FILE *infile, FILE *outfile, mpz_t n) {
+    uint64_t size = ss_block_bytes(n) + 1;
+    // ciphertexts are below n, so they never need more bytes than n has
+    uint64_t csize = (mpz_sizeinbase(n, 2) + 7) / 8;
+    // one contiguous array of block inputs for the whole batch, each
+    // starting with the 0xFF byte, plus scratch shared by every record
+    uint8_t *blocks = (uint8_t *) calloc(RECORD_BATCH * size, sizeof(uint8_t));
+    uint64_t *lens = (uint64_t *) calloc(RECORD_BATCH, sizeof(uint64_t));
+    uint8_t *out = (uint8_t *) calloc(csize, sizeof(uint8_t));
+    mpz_t *m = (mpz_t *) calloc(RECORD_BATCH, sizeof(mpz_t));
+    mpz_t *c = (mpz_t *) calloc(RECORD_BATCH, sizeof(mpz_t));
+    for (int i = 0; i < RECORD_BATCH; i++) {
+        mpz_inits(m[i], c[i], NULL);
+    }
+    bool ok = true;
+    bool eof = false;
+    while (!eof) {
+        // read up to RECORD_BATCH records straight into their blocks
+        size_t count = 0;
+        while (count < RECORD_BATCH) {
+            uint8_t *block = blocks + count * size;
+            int r = read_frame(infile, block + 1, size - 1, &lens[count]);
+            if (r <= 0) {
+                ok = r == 0;
+                eof = true;
+                break;
+            }
+            block[0] = 0xFF;
+            count += 1;
+        }
+        for (size_t i = 0; i < count; i++) {
+            mpz_import(m[i], lens[i] + 1, 1, 1, 1, 0, blocks + i * size);
+        }
+        // encrypt the batch and frame each ciphertext in record order
+        ss_encrypt_batch(c, m, count, n);
+        for (size_t i = 0; i < count; i++) {
+            size_t j = 0;
+            mpz_export(out, &j, 1, 1, 1, 0, c[i]);
+            write_frame(outfile, out, j);
+        }
+    }
+    for (int i = 0; i < RECORD_BATCH; i++) {
+        mpz_clears(m[i], c[i], NULL);
+    }
+    free(m);
+    free(c);
+    free(out);
+    free(lens);
+    free(blocks);
+    return ok;
+}
+
+// Decrypts a stream of ciphertext frames back into length-prefixed records
+bool ss_decrypt_records(FILE *infile, FILE *outfile, mpz_t d, mpz_t pq) {
+    // room for any value below pq, even from a corrupt frame
+    uint64_t size = (mpz_sizeinbase(pq, 2) + 7) / 8;
+    // n is at most 5/3 the size of pq, so twice pq bounds any ciphertext
+    uint64_t csize = 2 * ((mpz_sizeinbase(pq, 2) + 7) / 8);
+    uint8_t *in = (uint8_t *) calloc(csize, sizeof(uint8_t));
+    uint8_t *block = (uint8_t *) calloc(size, sizeof(uint8_t));
+    mpz_t *c = (mpz_t *) calloc(RECORD_BATCH, sizeof(mpz_t));
+    mpz_t *m = (mpz_t *) calloc(RECORD_BATCH, sizeof(mpz_t));
+    for (int i = 0; i < RECORD_BATCH; i++) {
+        mpz_inits(c[i], m[i], NULL);
+    }
+    bool ok = true;
+    bool eof = false;
+    while (!eof) {
+        // read up to RECORD_BATCH ciphertext frames
+        size_t count = 0;
+        while (count < RECORD_BATCH) {
+            uint64_t len = 0;
+            int r = read_frame(infile, in, csize, &len);
+            if (r <= 0) {
+                ok = r == 0;
+                eof = true;
+                break;
+            }
+            mpz_import(c[count], len, 1, 1, 1, 0, in);
+            count += 1;
+        }
+        // decrypt the batch and frame each record without its 0xFF byte
+        ss_decrypt_batch(m, c, count, d, pq);
+        for (size_t i = 0; i < count; i++) {
+            size_t j = 0;
+            mpz_export(block, &j, 1, 1, 1, 0, m[i]);
+            if (j < 1 || block[0] != 0xFF) {
+                ok = false;
+                break;
+            }
+            write_frame(outfile, block + 1, j - 1);
+        }
+        if (!ok) {
             break;
         }
-        // decrypt c back into m
-        ss_decrypt(m, c, d, pq);
-        // convert m back into bytes, stored in block
-        size_t j = 0; // used as count for bytes converted
-        mpz_export(block, &j, 1, 1, 1, 0, m);
-        // write out j - 1 bytes starting from index 1 of the block to outfile
-        fwrite(block + 1, sizeof(uint8_t), j - 1, outfile);
     }
+    for (int i = 0; i < RECORD_BATCH; i++) {
+        mpz_clears(c[i], m[i], NULL);
+    }
+    free(c);
+    free(m);
     free(block);
-    block = NULL;
-    mpz_clears(c, m, NULL);
+    free(in);
+    return ok;
+}
+
+// Decrypts infile under the old private key and encrypts it under the new
+// public key in one pass, without the plaintext ever leaving memory
+bool ss_reencrypt_file(
+    FILE *infile, FILE *outfile, mpz_t d, mpz_t pq, mpz_t n, uint32_t threads) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (!ss_key_fits(n)) {
+        return false;
+    }
+    // old blocks carry whatever the old key's block size was; the
+    // plaintext is re-cut into blocks for the new key as it streams by
+    size_t round = (size_t) threads * REENCRYPT_BATCH;
+    uint64_t oldsize = (mpz_sizeinbase(pq, 2) + 7) / 8;
+    uint64_t newsize = ss_block_bytes(n) + 1;
+    // everything decrypted in one round plus a partial new block left over
+    uint64_t cap = round * oldsize + newsize;
+    size_t maxnew = cap / (newsize - 1) + 1;
+    uint8_t *plain = (uint8_t *) calloc(cap, sizeof(uint8_t));
+    uint8_t *block = (uint8_t *) calloc(oldsize > newsize ? oldsize : newsize, sizeof(uint8_t));
+    mpz_t *c = (mpz_t *) calloc(round, sizeof(mpz_t));
+    mpz_t *m = (mpz_t *) calloc(round, sizeof(mpz_t));
+    mpz_t *mnew = (mpz_t *) calloc(maxnew, sizeof(mpz_t));
+    mpz_t *cnew = (mpz_t *) calloc(maxnew, sizeof(mpz_t));
+    for (size_t i = 0; i < round; i++) {
+        mpz_inits(c[i], m[i], NULL);
+    }
+    for (size_t i = 0; i < maxnew; i++) {
+        mpz_inits(mnew[i], cnew[i], NULL);
+    }
+    uint64_t pending = 0; // plaintext bytes not yet re-encrypted
+    bool ok = true;
+    bool eof = false;
+    while (ok && !eof) {
+        // scan in up to one round of old ciphertexts and decrypt them
+        size_t count = 0;
+        while (count < round) {
+            int r = gmp_fscanf(infile, "%Zx\n", c[count]);
+            if (r == EOF) {
+                eof = true;
+                break;
+            }
+            if (r < 1) { // not a hex ciphertext line
+                ok = false;
+                break;
+            }
+            count += 1;
+        }
+        pow_mod_parallel(m, c, count, d, pq, threads);
+        for (size_t i = 0; ok && i < count; i++) {
+            // strip the 0xFF byte and queue the plaintext in order; a block
+            // without it was cut short or made with another key
+            size_t j = 0;
+            mpz_export(block, &j, 1, 1, 1, 0, m[i]);
+            if (j < 1 || block[0] != 0xFF) {
+                ok = false;
+                break;
+            }
+            memcpy(plain + pending, block + 1, j - 1);
+            pending += j - 1;
+        }
+        // cut as many full new blocks as are ready, plus the tail at the end
+        size_t blocks = 0;
+        uint64_t used = 0;
+        block[0] = 0xFF;
+        while (pending - used >= newsize - 1 || (eof && pending > used)) {
+            uint64_t j = pending - used < newsize - 1 ? pending - used : newsize - 1;
+            memcpy(block + 1, plain + used, j);
+            mpz_import(mnew[blocks], j + 1, 1, 1, 1, 0, block);
+            used += j;
+            blocks += 1;
+        }
+        pow_mod_parallel(cnew, mnew, blocks, n, n, threads);
+        for (size_t i = 0; i < blocks; i++) {
+            gmp_fprintf(outfile, "%Zx\n", cnew[i]);
+        }
+        // keep the partial block for the next round
+        memmove(plain, plain + used, pending - used);
+        pending -= used;
+    }
+    for (size_t i = 0; i < round; i++) {
+        mpz_clears(c[i], m[i], NULL);
+    }
+    for (size_t i = 0; i < maxnew; i++) {
+        mpz_clears(mnew[i], cnew[i], NULL);
+    }
+    free(c);
+    free(m);
+    free(mnew);
+    free(cnew);
+    // neither buffer's plaintext should outlive the run in freed memory
+    explicit_bzero(block, oldsize > newsize ? oldsize : newsize);
+    explicit_bzero(plain, cap);
+    free(block);
+    free(plain);
+    return ok;
+}
+
+// Reads a checkpoint written by ss_write_checkpoint.
+// Returns 1 for a checkpoint, 0 if there is none and -1 if malformed.
+int ss_read_checkpoint(const char *path, ss_checkpoint_t *cp) {
+    FILE *cfile = fopen(path, "r");
+    if (cfile == NULL) {
+        return 0;
+    }
+    char line[2 * SHA256_BYTES + 2];
+    int found = -1;
+    if (fgets(line, sizeof(line), cfile) != NULL && strcmp(line, "ss-checkpoint\n") == 0
+        && fscanf(cfile, "%7s\n", cp->mode) == 1 && fgets(line, sizeof(line), cfile) != NULL
+        && strlen(line) == 2 * SHA256_BYTES + 1 && parse_digest(cp->key, line)
+        && fscanf(cfile, "%" SCNu64 "\n%" SCNd64 "\n%" SCNu64 "\n%" SCNu64 "\n%" SCNu64 "\n",
+               &cp->insize, &cp->mtime, &cp->inoff, &cp->outoff, &cp->blocks)
+               == 5) {
+        found = 1;
+    }
+    fclose(cfile);
+    return found;
+}
+
+// Makes outfile durable up to its current position, records that position
+// in cp and atomically replaces the checkpoint at path
+bool ss_write_checkpoint(const char *path, FILE *outfile, ss_checkpoint_t *cp) {
+    // the output has to reach the disk before a checkpoint may point past it
+    if (fflush(outfile) != 0 || fsync(fileno(outfile)) != 0) {
+        return false;
+    }
+    long pos = ftell(outfile);
+    if (pos < 0) {
+        return false;
+    }
+    cp->outoff = (uint64_t) pos;
+    char tmppath[PATH_MAX + 8];
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+    FILE *cfile = fopen(tmppath, "w");
+    if (cfile == NULL) {
+        return false;
+    }
+    fprintf(cfile, "ss-checkpoint\n%s\n", cp->mode);
+    put_digest(cfile, cp->key);
+    fprintf(cfile, "\n%" PRIu64 "\n%" PRId64 "\n%" PRIu64 "\n%" PRIu64 "\n%" PRIu64 "\n",
+        cp->insize, cp->mtime, cp->inoff, cp->outoff, cp->blocks);
+    bool ok = fflush(cfile) == 0 && fsync(fileno(cfile)) == 0;
+    ok = fclose(cfile) == 0 && ok;
+    // a crash leaves either the old checkpoint or the new one, never half of one
+    if (!ok || rename(tmppath, path) != 0) {
+        return false;
+    }
+    // sync the directory too so the rename itself survives a crash
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else {
+        slash[slash == dir ? 1 : 0] = '\0';
+    }
+    int fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return true;
+}
+
+// Finds the size of f by seeking to its end
+static bool file_size(FILE *f, uint64_t *size) {
+    long end = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    *size = (uint64_t) end;
+    return end >= 0;
+}
+
+// Picks up a resumable run of mode under modulus key: loads the checkpoint
+// at path (or starts from zero without one), checks that it was made for
+// this run, cuts outfile back to the last checkpointed block and positions
+// both files there
+static bool resume_from(const char *path, FILE *infile, FILE *outfile, ss_checkpoint_t *cp,
+    const char *mode, mpz_t key) {
+    // what this run is, which a checkpoint left by it has to match
+    ss_checkpoint_t run = { .inoff = 0, .outoff = 0, .blocks = 0 };
+    struct stat st;
+    if (fstat(fileno(infile), &st) != 0) {
+        return false;
+    }
+    snprintf(run.mode, sizeof(run.mode), "%s", mode);
+    key_hash(run.key, key);
+    run.insize = (uint64_t) st.st_size;
+    run.mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    *cp = run;
+    int found = ss_read_checkpoint(path, cp);
+    if (found < 0
+        || (found > 0
+            && (strcmp(cp->mode, run.mode) != 0 || memcmp(cp->key, run.key, SHA256_BYTES) != 0
+                || cp->insize != run.insize || cp->mtime != run.mtime))) {
+        return false;
+    }
+    // a checkpoint only points at input that exists and output already on disk
+    uint64_t insize, outsize;
+    if (!file_size(infile, &insize) || !file_size(outfile, &outsize) || cp->inoff > insize
+        || cp->outoff > outsize) {
+        return false;
+    }
+    // anything past the checkpoint may be a partly written block
+    if (fflush(outfile) != 0 || ftruncate(fileno(outfile), cp->outoff) != 0) {
+        return false;
+    }
+    return fseek(outfile, cp->outoff, SEEK_SET) == 0 && fseek(infile, cp->inoff, SEEK_SET) == 0;
+}
+
+// Finishes a resumable run by syncing outfile and removing the checkpoint
+static bool resume_done(const char *path, FILE *outfile) {
+    if (fflush(outfile) != 0 || fsync(fileno(outfile)) != 0) {
+        return false;
+    }
+    return remove(path) == 0 || errno == ENOENT;
+}
+
+// Encrypts infile to outfile, checkpointing so an interrupted run can resume
+bool ss_encrypt_resumable(FILE *infile, FILE *outfile, mpz_t n, const char *checkpoint) {
+    ss_checkpoint_t cp;
+    uint64_t total;
+    if (!resume_from(checkpoint, infile, outfile, &cp, "encrypt", n)
+        || !file_size(infile, &total)) {
+        return false;
+    }
+    // encrypt whatever is left after the checkpoint
+    return encrypt_range(infile, outfile, n, cp.inoff, total - cp.inoff, checkpoint, &cp)
+           && resume_done(checkpoint, outfile);
+}
+
+// Decrypts infile to outfile, checkpointing so an interrupted run can resume
+bool ss_decrypt_resumable(FILE *infile, FILE *outfile, mpz_t d, mpz_t pq, const char *checkpoint) {
+    ss_checkpoint_t cp;
+    if (!resume_from(checkpoint, infile, outfile, &cp, "decrypt", pq)) {
+        return false;
+    }
+    uint64_t written = 0;
+    return decrypt_lines(infile, outfile, d, pq, &written, checkpoint, &cp)
+           && resume_done(checkpoint, outfile);
 }
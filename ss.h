@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <gmp.h>
+#include "randstate.h"
+#include "cache.h"
+#include "sha256.h"
 
 //
 // Generates the components for a new SS key.
@@ -16,9 +19,71 @@
 // Requires:
 //  nbits: minimum # of bits in n
 //  iters: iterations of Miller-Rabin to use for primality check
+//  rs: initialized random state
 //  all mpz_t arguments to be initialized
 //
-void ss_make_pub(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t iters);
+void ss_make_pub(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t iters, randstate_t *rs);
+
+//
+// Generates the components for a new SS key with a chosen size for p.
+//
+// Provides:
+//  p:  first prime
+//  q: second prime
+//  n: public modulus/exponent
+//
+// Requires:
+//  nbits: minimum # of bits in n
+//  sizeofp: # of bits in p, below nbits / 2
+//  iters: iterations of Miller-Rabin to use for primality check
+//  rs: initialized random state; p and q are searched for in parallel on
+//      streams split from it
+//  all mpz_t arguments to be initialized
+//
+void ss_make_pub_split(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t sizeofp,
+    uint64_t iters, randstate_t *rs);
+
+//
+// Key profiles for choosing how n is split between p and q.
+//
+// SS_PROFILE_THROUGHPUT: fastest decryption of whole files (batched blocks)
+// SS_PROFILE_LATENCY:    fastest decryption of a single block
+//
+typedef enum { SS_PROFILE_THROUGHPUT, SS_PROFILE_LATENCY } ss_profile_t;
+
+// smallest q a key profile may choose, in bits; q is the smaller prime
+// factor of n, and the elliptic curve method finds small factors cheaply
+#define SS_MIN_QBITS 384
+
+//
+// Chooses the size of p for a key under a profile, from a fixed model of
+// decryption cost, so the choice depends only on nbits and profile. The
+// split is a fixed rule: it never looks at ss_calibrate's measurements.
+// q is kept at SS_MIN_QBITS or more when nbits allows it, and as large as
+// the usual range of p allows otherwise.
+//
+// Requires:
+//  nbits: minimum # of bits in n
+//  profile: which cost to minimize
+//
+uint64_t ss_profile_psize(uint64_t nbits, ss_profile_t profile);
+
+//
+// Predicts encryption and decryption speed for a key pair
+//
+// Provides:
+//  encrate: predicted encryption rate in plaintext bytes per second
+//  decrate: predicted decryption rate in plaintext bytes per second
+//
+// Requires:
+//  n: public modulus/exponent
+//  d: private exponent
+//  pq: private modulus
+//  batched: time full batches of blocks (files) rather than single blocks
+//  rs: initialized random state
+//
+void ss_calibrate(mpz_t n, mpz_t d, mpz_t pq, bool batched, double *encrate, double *decrate,
+    randstate_t *rs);
 
 //
 // Generates components for a new SS private key.
@@ -63,7 +128,7 @@ void ss_write_priv(mpz_t pq, mpz_t d, FILE *pvfile);
 //
 // Requires:
 //  pbfile: open and readable file stream
-//  username: requires sufficient space
+//  username: room for LOGIN_NAME_MAX bytes; longer names are cut short
 //  all mpz_t arguments to be initialized
 //
 void ss_read_pub(mpz_t n, char username[], FILE *pbfile);
@@ -94,6 +159,32 @@ void ss_read_priv(mpz_t pq, mpz_t d, FILE *pvfile);
 //
 void ss_encrypt(mpz_t c, mpz_t m, mpz_t n);
 
+//
+// Encrypt k numbers at once under the same public key
+//
+// Provides:
+//  c: k encrypted integers, c[i] = E(m[i])
+//
+// Requires:
+//  m: k original integers
+//  n: public exponent/modulus
+//  all mpz_t arguments to be initialized
+//
+void ss_encrypt_batch(mpz_t c[], mpz_t m[], size_t k, mpz_t n);
+
+//
+// Use a cache of block results in the file loops
+//
+// Once set, the encrypt and decrypt file loops (whole files, ranges and
+// resumable runs) look every block up in cache first and only exponentiate
+// the misses. The cache must only ever hold results for one key and one
+// direction.
+//
+// Requires:
+//  cache: initialized cache, or NULL to stop using one
+//
+void ss_use_cache(cache_t *cache);
+
 //
 // Encrypt an arbitrary file
 //
@@ -107,6 +198,139 @@ void ss_encrypt(mpz_t c, mpz_t m, mpz_t n);
 //
 void ss_encrypt_file(FILE *infile, FILE *outfile, mpz_t n);
 
+//
+// Whether n is large enough for its blocks to carry any plaintext
+//
+// Requires:
+//  n: public exponent and modulus
+//
+bool ss_key_fits(mpz_t n);
+
+//
+// Number of plaintext bytes carried by each encrypted block
+//
+// Requires:
+//  n: public exponent and modulus, with ss_key_fits(n)
+//
+uint64_t ss_block_bytes(mpz_t n);
+
+//
+// Encrypt a byte range of a file
+//
+// Provides:
+//  fills outfile with the encrypted contents of length bytes of infile,
+//  starting at offset. Ranges that start on a block boundary produce the
+//  same lines ss_encrypt_file would, so shards can simply be concatenated.
+//
+// Requires:
+//  infile: open, readable and seekable file stream
+//  outfile: open and writable file stream
+//  n: public exponent and modulus
+//
+void ss_encrypt_range(FILE *infile, FILE *outfile, mpz_t n, uint64_t offset, uint64_t length);
+
+//
+// Hash a plaintext block
+//
+// Uses SHA-256, so two blocks with the same hash can be taken to be the
+// same block.
+//
+// Provides:
+//  h: the SHA-256 digest of buf
+//
+// Requires:
+//  buf: len bytes of plaintext
+//
+void ss_block_hash(uint8_t h[SHA256_BYTES], const uint8_t *buf, uint64_t len);
+
+//
+// Encrypt a file, reusing the ciphertext of blocks that did not change
+//
+// A hash manifest holds the block size, a hash of the public key and, for
+// each block, the ss_block_hash of its plaintext and a SHA-256 of that
+// digest followed by its ciphertext line.
+// Given the previous ciphertext of the file and its manifest, each block
+// whose plaintext hash still matches has its old ciphertext line copied
+// through, and only changed blocks are encrypted.
+// Blocks are fixed-size, so edits in place save the most work, while an
+// insertion or deletion changes every block after it.
+//
+// Provides:
+//  fills outfile with exactly what ss_encrypt_file would produce
+//  writes this run's manifest to hashfile, unless it is NULL
+//  blocks: number of blocks in infile
+//  reused: number of blocks copied from prevfile
+//  returns false if prevhashes is malformed or was made for another key or
+//  block size, or a line of prevfile does not match its hash in prevhashes
+//
+// Requires:
+//  infile: open and readable file stream, not stdin
+//  outfile: open and writable file stream
+//  n: public exponent and modulus
+//  prevfile: previous ciphertext of the file, or NULL
+//  prevhashes: manifest written with prevfile, or NULL
+//  hashfile: open and writable file stream for the new manifest, or NULL
+//
+bool ss_encrypt_incremental(FILE *infile, FILE *outfile, mpz_t n, FILE *prevfile,
+    FILE *prevhashes, FILE *hashfile, uint64_t *blocks, uint64_t *reused);
+
+//
+// Split a plaintext into block-aligned shards
+//
+// Provides:
+//  offset: first plaintext byte of shard index
+//  length: plaintext bytes in shard index (may be 0)
+//
+// Requires:
+//  total: plaintext size in bytes
+//  blockbytes: plaintext bytes per block (see ss_block_bytes)
+//  index: shard number, 0 <= index < count
+//  count: number of shards
+//
+void ss_shard_range(uint64_t total, uint64_t blockbytes, uint64_t index, uint64_t count,
+    uint64_t *offset, uint64_t *length);
+
+//
+// Largest number of shards a plaintext may be split into
+//
+// Requires:
+//  total: plaintext size in bytes
+//  blockbytes: plaintext bytes per block, at least 1
+//
+uint64_t ss_max_shards(uint64_t total, uint64_t blockbytes);
+
+//
+// Write a manifest that ties shard ciphertexts into one logical ciphertext
+//
+// Requires:
+//  mfile: open and writable file stream
+//  total: plaintext size in bytes
+//  blockbytes: plaintext bytes per block
+//  shards: ciphertext file of each shard, in shard order
+//  count: number of shards
+//
+void ss_write_manifest(FILE *mfile, uint64_t total, uint64_t blockbytes, char *shards[],
+    uint64_t count);
+
+//
+// Read a manifest written by ss_write_manifest
+//
+// Provides:
+//  total, blockbytes, count: as written
+//  returns a heap array of count shard file names, to be released with
+//  ss_clear_manifest, or NULL if the manifest is malformed, lists more
+//  shards than ss_max_shards allows, or the names cannot be allocated
+//
+// Requires:
+//  mfile: open and readable file stream
+//
+char **ss_read_manifest(FILE *mfile, uint64_t *total, uint64_t *blockbytes, uint64_t *count);
+
+//
+// Free the shard list returned by ss_read_manifest
+//
+void ss_clear_manifest(char **shards, uint64_t count);
+
 //
 // Decrypt number c into number m
 //
@@ -121,11 +345,28 @@ void ss_encrypt_file(FILE *infile, FILE *outfile, mpz_t n);
 //
 void ss_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t pq);
 
+//
+// Decrypt k numbers at once under the same private key
+//
+// Provides:
+//  m: k decrypted integers, m[i] = D(c[i])
+//
+// Requires:
+//  c: k encrypted integers
+//  d: private exponent
+//  pq: private modulus
+//  all mpz_t arguments to be initialized
+//
+void ss_decrypt_batch(mpz_t m[], mpz_t c[], size_t k, mpz_t d, mpz_t pq);
+
 //
 // Decrypt a file back into its original form.
 //
 // Provides:
 //  fills outfile with the unencrypted data from infile
+//  written: the number of bytes written to outfile
+//  returns false if a line of infile is not a hex ciphertext; outfile
+//  then holds the plaintext of the lines before it
 //
 // Requires:
 //  infile: open and readable file stream to encrypted data
@@ -133,4 +374,143 @@ void ss_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t pq);
 //  d: private exponent
 //  pq: private modulus
 //
-void ss_decrypt_file(FILE *infile, FILE *outfile, mpz_t d, mpz_t pq);
+bool ss_decrypt_file(FILE *infile, FILE *outfile, mpz_t d, mpz_t pq, uint64_t *written);
+
+//
+// Encrypt a stream of small records
+//
+// Records are framed as a 4-byte big-endian length followed by that many
+// bytes, and each must fit in one block (see ss_block_bytes). Records are
+// read in batches into one contiguous array of block inputs and share one
+// key context, so each costs little more than one exponentiation.
+//
+// Provides:
+//  fills outfile with one framed ciphertext per input record, in order
+//  returns false if a record is too long or the stream is truncated
+//
+// Requires:
+//  infile: open and readable stream of framed records
+//  outfile: open and writable file stream
+//  n: public exponent and modulus
+//
+bool ss_encrypt_records(FILE *infile, FILE *outfile, mpz_t n);
+
+//
+// Decrypt a stream of framed ciphertexts from ss_encrypt_records
+//
+// Provides:
+//  fills outfile with one framed plaintext record per ciphertext, in order
+//  returns false if a frame is malformed or does not decrypt to a record
+//
+// Requires:
+//  infile: open and readable stream of framed ciphertexts
+//  outfile: open and writable file stream
+//  d: private exponent
+//  pq: private modulus
+//
+bool ss_decrypt_records(FILE *infile, FILE *outfile, mpz_t d, mpz_t pq);
+
+//
+// Re-encrypt a file from an old key pair to a new public key in one pass
+//
+// Blocks are decrypted and re-encrypted in memory, a bounded batch at a
+// time spread over worker threads, so no plaintext is written out.
+//
+// Provides:
+//  fills outfile with exactly what ss_encrypt_file under n would produce
+//  for the plaintext of infile
+//  returns false if n is too small (see ss_key_fits), or a line of infile
+//  is not a ciphertext of the old key; outfile then holds a prefix
+//
+// Requires:
+//  infile: open and readable file stream to encrypted data
+//  outfile: open and writable file stream
+//  d: old private exponent
+//  pq: old private modulus
+//  n: new public exponent and modulus
+//  threads: number of worker threads to use
+//
+bool ss_reencrypt_file(
+    FILE *infile, FILE *outfile, mpz_t d, mpz_t pq, mpz_t n, uint32_t threads);
+
+//
+// Progress of a resumable encryption or decryption. The first fields name
+// the run a checkpoint belongs to, so it is never applied to another; the
+// rest describe the same consistent point: a round boundary whose output
+// is on disk.
+//
+typedef struct {
+    char mode[8]; // "encrypt" or "decrypt"
+    uint8_t key[SHA256_BYTES]; // SHA-256 of the modulus in use
+    uint64_t insize; // size of the input file
+    int64_t mtime; // modification time of the input file, in nanoseconds
+    uint64_t inoff; // input bytes consumed
+    uint64_t outoff; // output bytes written and synced
+    uint64_t blocks; // blocks processed
+} ss_checkpoint_t;
+
+//
+// Read a checkpoint file
+//
+// Provides:
+//  cp: the saved progress when found
+//  returns 1 if a checkpoint was read, 0 if path does not exist and -1 if
+//  it is malformed
+//
+// Requires:
+//  path: checkpoint file to read
+//
+int ss_read_checkpoint(const char *path, ss_checkpoint_t *cp);
+
+//
+// Save a checkpoint file
+//
+// outfile is flushed and fsynced first, and its position becomes
+// cp->outoff. The checkpoint is written to a temporary file, fsynced and
+// renamed over path, so a crash at any point leaves a usable checkpoint.
+//
+// Provides:
+//  returns false if the output or the checkpoint could not be synced
+//
+// Requires:
+//  path: checkpoint file to replace
+//  outfile: open file stream being written by the run
+//  cp: progress to save
+//
+bool ss_write_checkpoint(const char *path, FILE *outfile, ss_checkpoint_t *cp);
+
+//
+// Encrypt a file, saving progress so an interrupted run can pick up again
+//
+// If checkpoint exists, outfile is truncated to its output offset and
+// encryption continues from its input offset; otherwise it starts from the
+// top. Progress is checkpointed every few seconds, and the checkpoint is
+// removed once the whole file is encrypted. The output is the same as
+// ss_encrypt_file's, however many times the run was interrupted.
+//
+// Provides:
+//  returns false if the checkpoint was made for another mode, key or
+//  input (by size and modification time), does not fit the files, or
+//  cannot be saved
+//
+// Requires:
+//  infile: open, readable and seekable file stream
+//  outfile: open, writable and seekable file stream, not truncated on open
+//  n: public exponent and modulus
+//  checkpoint: path of the checkpoint file
+//
+bool ss_encrypt_resumable(FILE *infile, FILE *outfile, mpz_t n, const char *checkpoint);
+
+//
+// Decrypt a file, saving progress so an interrupted run can pick up again
+//
+// Works like ss_encrypt_resumable, producing what ss_decrypt_file would.
+//
+// Requires:
+//  infile: open, readable and seekable file stream to encrypted data
+//  outfile: open, writable and seekable file stream, not truncated on open
+//  d: private exponent
+//  pq: private modulus
+//  checkpoint: path of the checkpoint file
+//
+bool ss_decrypt_resumable(FILE *infile, FILE *outfile, mpz_t d, mpz_t pq, const char *checkpoint);
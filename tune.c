@@ -0,0 +1,261 @@
+#include "tune.h"
+#include "numtheory.h"
+#include "randstate.h"
+#include "ifma.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <gmp.h>
+
+// minimum length of one timing measurement, in seconds
+#define TUNE_SECONDS 0.05
+// largest number of blocks one thread takes per round
+#define MAX_BATCH 64
+
+// largest stdio buffer tried or accepted from a profile, in bytes
+#define MAX_IOBUF (1 << 20)
+
+// defaults match the untuned behaviour: one thread, a 4-bit window,
+// one kernel's worth of blocks per round and stdio's own buffer size
+tune_t tuning = { 1, 4, IFMA_LANES, 0 };
+
+// Returns the window width clamped to what the backends support
+uint32_t tune_window(void) {
+    if (tuning.window < 1) {
+        return 1;
+    }
+    return tuning.window > TUNE_MAX_WINDOW ? TUNE_MAX_WINDOW : tuning.window;
+}
+
+// Returns the per-host profile path
+const char *tune_path(void) {
+    static char path[PATH_MAX];
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+    const char *home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/.ss-tune-%s", home != NULL ? home : ".", host);
+    return path;
+}
+
+// Returns the number of online CPUs, at least 1
+static uint32_t online_cpus(void) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? (uint32_t) online : 1;
+}
+
+// Loads the profile entry for program and bits into tuning
+bool tune_load(const char *path, const char *program, uint64_t bits) {
+    FILE *profile = fopen(path, "r");
+    if (profile == NULL) {
+        return false;
+    }
+    // one entry per line: program bits threads window batch iobuf; entries
+    // outside what tune_run could have chosen are ignored, since threads *
+    // batch sizes the file loops' buffers
+    char line[256];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), profile) != NULL) {
+        char name[16];
+        uint64_t size;
+        tune_t t;
+        if (sscanf(line, "%15s %" SCNu64 " %" SCNu32 " %" SCNu32 " %" SCNu32 " %" SCNu32, name,
+                &size, &t.threads, &t.window, &t.batch, &t.iobuf)
+                == 6
+            && strcmp(name, program) == 0 && size == bits && t.threads > 0
+            && t.threads <= online_cpus() && t.batch > 0 && t.batch <= MAX_BATCH
+            && t.iobuf <= MAX_IOBUF) {
+            tuning = t;
+            found = true;
+        }
+    }
+    fclose(profile);
+    return found;
+}
+
+// Saves tuning as the profile entry for program and bits
+bool tune_save(const char *path, const char *program, uint64_t bits) {
+    char tmppath[PATH_MAX + 8];
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+    FILE *out = fopen(tmppath, "w");
+    if (out == NULL) {
+        return false;
+    }
+    // copy every other entry over, then add this one
+    FILE *in = fopen(path, "r");
+    if (in != NULL) {
+        char line[256];
+        while (fgets(line, sizeof(line), in) != NULL) {
+            char name[16];
+            uint64_t size;
+            if (sscanf(line, "%15s %" SCNu64, name, &size) == 2
+                && (strcmp(name, program) != 0 || size != bits)) {
+                fputs(line, out);
+            }
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s %" PRIu64 " %" PRIu32 " %" PRIu32 " %" PRIu32 " %" PRIu32 "\n", program, bits,
+        tuning.threads, tuning.window, tuning.batch, tuning.iobuf);
+    bool ok = fclose(out) == 0;
+    // replace the old profile in one step so readers never see half of it
+    return ok && rename(tmppath, path) == 0;
+}
+
+// Returns the current time in seconds
+double tune_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Measures seconds per block for rounds of k exponentiations over threads
+double tune_pow_time(mpz_t o[], mpz_t a[], size_t k, mpz_t d, mpz_t mod, uint32_t threads,
+    double seconds) {
+    uint64_t blocks = 0;
+    double start = tune_now();
+    double elapsed = 0;
+    // repeat until the measurement is long enough to trust
+    while (elapsed < seconds) {
+        pow_mod_parallel(o, a, k, d, mod, threads);
+        blocks += k;
+        elapsed = tune_now() - start;
+    }
+    return elapsed / blocks;
+}
+
+// Measures the seconds loop takes over sample with a given buffer size,
+// or returns a negative time if the run could not be set up or failed
+static double file_time(const uint8_t *sample, size_t len, tune_loop_t *loop, void *arg,
+    uint32_t iobuf) {
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    double elapsed = -1;
+    // buffers have to be set before the streams are first used
+    if (in != NULL && out != NULL && setvbuf(in, NULL, _IOFBF, iobuf) == 0
+        && setvbuf(out, NULL, _IOFBF, iobuf) == 0
+        && fwrite(sample, sizeof(uint8_t), len, in) == len && fseek(in, 0, SEEK_SET) == 0) {
+        double start = tune_now();
+        if (loop(in, out, arg) && fflush(out) == 0) {
+            elapsed = tune_now() - start;
+        }
+    }
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+    return elapsed;
+}
+
+// Fills a new sample with blocks * blockbytes random bytes
+size_t tune_sample_plain(uint8_t **sample, uint64_t blocks, uint64_t blockbytes) {
+    size_t len = blocks * blockbytes;
+    *sample = (uint8_t *) malloc(len);
+    if (*sample == NULL) {
+        return 0;
+    }
+    randstate_t rs;
+    randstate_init(&rs, time(NULL));
+    for (size_t i = 0; i < len; i++) {
+        (*sample)[i] = (uint8_t) randstate_u64(&rs);
+    }
+    randstate_clear(&rs);
+    return len;
+}
+
+// Reads up to blocks whole ciphertext lines from the top of infile into
+// *sample without moving or buffering the stream
+size_t tune_sample_lines(uint8_t **sample, uint64_t blocks, FILE *infile, mpz_t mod) {
+    *sample = NULL;
+    struct stat st;
+    int fd = fileno(infile);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+    // a ciphertext is below n, which has at most twice the bits of pq
+    size_t cap = blocks * (2 * mpz_sizeinbase(mod, 16) + 2);
+    *sample = (uint8_t *) malloc(cap);
+    if (*sample == NULL) {
+        return 0;
+    }
+    ssize_t got = pread(fd, *sample, cap, 0);
+    size_t len = got > 0 ? (size_t) got : 0;
+    // drop any partly read line at the end
+    while (len > 0 && (*sample)[len - 1] != '\n') {
+        len -= 1;
+    }
+    return len;
+}
+
+// Calibrates window width, threads, batch size and I/O buffer size
+void tune_run(
+    mpz_t d, mpz_t mod, const uint8_t *sample, size_t len, tune_loop_t *loop, void *arg) {
+    randstate_t rs;
+    randstate_init(&rs, time(NULL));
+    uint32_t maxthreads = online_cpus();
+    size_t cap = (size_t) maxthreads * MAX_BATCH;
+    mpz_t *a = (mpz_t *) calloc(cap, sizeof(mpz_t));
+    mpz_t *o = (mpz_t *) calloc(cap, sizeof(mpz_t));
+    for (size_t i = 0; i < cap; i++) {
+        mpz_inits(a[i], o[i], NULL);
+        randstate_urandomm(a[i], &rs, mod);
+    }
+
+    // window width, timed on one kernel's worth of blocks
+    uint32_t bestwindow = tuning.window;
+    double besttime = 0;
+    for (uint32_t w = 1; w <= TUNE_MAX_WINDOW; w++) {
+        tuning.window = w;
+        double t = tune_pow_time(o, a, IFMA_LANES, d, mod, 1, TUNE_SECONDS);
+        if (besttime == 0 || t < besttime) {
+            bestwindow = w;
+            besttime = t;
+        }
+    }
+    tuning.window = bestwindow;
+
+    // thread count and blocks per thread, timed together since more
+    // threads need larger rounds to pay for starting them
+    besttime = 0;
+    for (uint32_t threads = 1;; threads = threads * 2 < maxthreads ? threads * 2 : maxthreads) {
+        for (uint32_t batch = IFMA_LANES; batch <= MAX_BATCH; batch *= 2) {
+            size_t k = (size_t) threads * batch;
+            double t = tune_pow_time(o, a, k, d, mod, threads, TUNE_SECONDS);
+            if (besttime == 0 || t < besttime) {
+                tuning.threads = threads;
+                tuning.batch = batch;
+                besttime = t;
+            }
+        }
+        if (threads == maxthreads) {
+            break;
+        }
+    }
+
+    // I/O buffer size, timed through the program's own file loop; runs
+    // that fail are not counted
+    besttime = 0;
+    for (uint32_t iobuf = 4096; len > 0 && iobuf <= MAX_IOBUF; iobuf *= 4) {
+        double t = file_time(sample, len, loop, arg, iobuf);
+        if (t >= 0 && (besttime == 0 || t < besttime)) {
+            tuning.iobuf = iobuf;
+            besttime = t;
+        }
+    }
+
+    for (size_t i = 0; i < cap; i++) {
+        mpz_clears(a[i], o[i], NULL);
+    }
+    free(a);
+    free(o);
+    randstate_clear(&rs);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <gmp.h>
+
+// largest exponent window width the IFMA kernel supports
+#define TUNE_MAX_WINDOW 6
+// blocks in the sample input used to time the file loop
+#define TUNE_SAMPLE_BLOCKS 32
+
+//
+// Performance parameters for the encrypt and decrypt file loops.
+//
+typedef struct {
+    uint32_t threads; // worker threads exponentiating blocks
+    uint32_t window; // exponent window width in bits, 1..TUNE_MAX_WINDOW
+    uint32_t batch; // blocks each thread takes per round of the file loop
+    uint32_t iobuf; // stdio buffer size in bytes for infile and outfile
+} tune_t;
+
+//
+// The parameters in use. Starts out with built-in defaults and is replaced
+// by tune_load or tune_run.
+//
+extern tune_t tuning;
+
+//
+// Returns tuning.window clamped to 1..TUNE_MAX_WINDOW.
+//
+uint32_t tune_window(void);
+
+//
+// Returns the path of this host's profile file, $HOME/.ss-tune-<hostname>
+// (or ./.ss-tune-<hostname> without $HOME). The string is static.
+//
+const char *tune_path(void);
+
+//
+// Loads the parameters saved for a program and modulus size, if any.
+//
+// Provides:
+//  tuning: replaced with the saved parameters when found
+//  returns true if a matching entry was found
+//
+// Requires:
+//  path: profile file to read
+//  program: "encrypt" or "decrypt"
+//  bits: size of the modulus in bits
+//
+bool tune_load(const char *path, const char *program, uint64_t bits);
+
+//
+// Saves tuning as the parameters for a program and modulus size, replacing
+// any older entry for the same pair and keeping all others.
+//
+// Returns false if the profile file could not be written.
+//
+bool tune_save(const char *path, const char *program, uint64_t bits);
+
+//
+// Returns a monotonic clock reading in seconds.
+//
+double tune_now(void);
+
+//
+// Measures the seconds per block of pow_mod_parallel, repeating rounds of k
+// exponentiations until at least seconds have passed.
+//
+// Requires:
+//  o, a: k initialized results and bases
+//  d: exponent
+//  mod: modulus
+//  threads: worker threads for each round
+//
+double tune_pow_time(mpz_t o[], mpz_t a[], size_t k, mpz_t d, mpz_t mod, uint32_t threads,
+    double seconds);
+
+//
+// A program's file loop, run by tune_run from in to out to time I/O buffer
+// sizes. arg is passed through unchanged. Returns false if the loop failed.
+//
+typedef bool tune_loop_t(FILE *in, FILE *out, void *arg);
+
+//
+// Builds a sample of random plaintext for timing the encrypt file loop.
+//
+// Provides:
+//  *sample: blocks * blockbytes random bytes, to be freed by the caller
+//  returns the sample length, 0 if it could not be allocated
+//
+size_t tune_sample_plain(uint8_t **sample, uint64_t blocks, uint64_t blockbytes);
+
+//
+// Reads whole ciphertext lines from the top of infile with pread, leaving
+// the stream untouched, for timing the decrypt file loop.
+//
+// Provides:
+//  *sample: up to blocks lines, to be freed by the caller
+//  returns the sample length, 0 if infile is not a regular file or the
+//   sample could not be allocated
+//
+// Requires:
+//  mod: pq, bounding the length of a ciphertext line
+//
+size_t tune_sample_lines(uint8_t **sample, uint64_t blocks, FILE *infile, mpz_t mod);
+
+//
+// Runs short calibrations of pow_mod and the file loop and stores the
+// fastest parameters found in tuning.
+//
+// Requires:
+//  d: exponent (n when encrypting)
+//  mod: modulus (n when encrypting, pq when decrypting)
+//  sample, len: input shaped like the program's own (see tune_sample_plain
+//   and tune_sample_lines); the I/O buffer size is left alone if len is 0
+//  loop, arg: the program's file loop, timed over sample
+//
+void tune_run(
+    mpz_t d, mpz_t mod, const uint8_t *sample, size_t len, tune_loop_t *loop, void *arg);